@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+#include "../fswtotex.h"
+
+using namespace std;
+using namespace fswtotex;
+
+/*
+    For make check: convert standard in to standard out through begin, feed
+    and finish, a few bytes at a time, so that characters, byte order marks
+    and words are cut in two between pieces. What comes out should be what
+    fswtotex writes, but for the command line it puts at the end.
+*/
+
+int main(int argc, char** argv)
+{
+    size_t piece = argc > 1 ? atoi(argv[1]) : 0;
+    if (argc != 2 || piece == 0)
+    {
+        cout << "feed <bytes at a time> < input > output" << endl;
+        return -1;
+    }
+    string text((istreambuf_iterator<char>(cin)), istreambuf_iterator<char>());
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(text.data());
+    Converter converter((Options()));
+    try
+    {
+        converter.begin(&cout);
+        for (size_t place = 0; place < text.size(); place += piece)
+            converter.feed(bytes + place, min(piece, text.size() - place));
+        converter.finish();
+    }
+    catch (char const* message)
+    {
+        cout << "Failure: " << message << endl;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,598 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fswtotex.h"
+
+using namespace std;
+using namespace fswtotex;
+
+/*
+    This is fswbench, which times libfswtotex on text made up to look like
+    what people actually write: LaTeX with signs in it, some of it mostly
+    prose with the odd sign, some of it glossaries that are nearly all signs.
+
+    The text is made from a fixed seed, so every run, on every machine, times
+    exactly the same bytes, and two builds can be compared by their results
+    files. Each corpus is timed in stages:
+        parse          -- finding and reading every sign, with nothing written
+        parse-utf16le  -- the same for a utf16le copy of the corpus, which is
+                          decoded a block at a time on the way (utf8 never
+                          is, see convertUtf8)
+        decode-utf16le -- just the decoding of that copy, with no looking
+                          for signs in it
+        emit           -- just writing the TikZ for every sign, read once
+                          beforehand, and none of the text between them
+    and then from end to end with each set of options that changes what is
+    written. Each is run several times and the fastest is kept.
+*/
+
+// The made-up text is built as utf-32 and then written out as utf8, and as
+// utf16le to time the decoder too.
+
+struct Symbol
+{
+    int key;
+    int x;
+    int y;
+};
+
+struct Word
+{
+    char lane;
+    int width;
+    int height;
+    vector<int> prefix;
+    vector<Symbol> symbols;
+};
+
+// What each corpus is made of: how much of it (in characters) is signs, how many
+// of those are written in swu rather than fsw, and how many have a prefix.
+struct Corpus
+{
+    const char* name;
+    int signShare;
+    int swuShare;
+    int prefixShare;
+    bool glossary;
+};
+
+const Corpus corpora[] =
+{
+    { "prose", 5, 0, 20, false },
+    { "mixed", 30, 50, 30, false },
+    { "glossary", 80, 0, 30, true },
+    { "swu", 50, 100, 30, false },
+    { "spelling", 50, 0, 100, false },
+};
+
+// How many different signs there are to choose from.
+const size_t vocabularySize = 2000;
+
+class Generator
+{
+public:
+    Generator();
+    vector<uint32_t> make(const Corpus& corpus, size_t size);
+
+private:
+    mt19937_64 random;
+    vector<Word> vocabulary;
+
+    int between(int low, int high);
+    int anyKey();
+    void number(vector<uint32_t>& text, int n, bool swu);
+    void key(vector<uint32_t>& text, int k, bool swu);
+    void word(vector<uint32_t>& text, const Word& w, bool swu, bool prefixed);
+    void punctuation(vector<uint32_t>& text, bool swu);
+    void prose(vector<uint32_t>& text);
+};
+
+Generator::Generator() : random(20240612)
+{
+    // Real signs have a handful of symbols each, clustered around the middle
+    // of the box, and most of them are in the middle lane.
+    const char lanes[] = "MMMMMBLR";
+    for (size_t i = 0; i < vocabularySize; i++)
+    {
+        Word w;
+        w.lane = lanes[random() % 8];
+        w.width = between(500, 560);
+        w.height = between(500, 560);
+        int symbols = between(1, 6);
+        for (int j = 0; j < symbols; j++)
+        {
+            Symbol s = { anyKey(), between(440, 560), between(440, 560) };
+            w.symbols.push_back(s);
+            // The prefix spells out the symbols, with a few S387 and S388
+            // column markers thrown in.
+            if (random() % 8 == 0)
+                w.prefix.push_back((0x287 + static_cast<int>(random() % 2)) * 96);
+            w.prefix.push_back(s.key);
+        }
+        vocabulary.push_back(w);
+    }
+}
+
+int Generator::between(int low, int high)
+{
+    return low + static_cast<int>(random() % (high - low + 1));
+}
+
+// A key counts symbols from S10000, as swu does: 96 for each base, 16 for
+// each fill and then the rotation. Anything from S387 on is punctuation.
+int Generator::anyKey()
+{
+    return between(0, 0x286) * 96 + between(0, 5) * 16 + between(0, 15);
+}
+
+void Generator::number(vector<uint32_t>& text, int n, bool swu)
+{
+    if (swu)
+    {
+        text.push_back(0x1d80c + n - 250);
+        return;
+    }
+    text.push_back('0' + n / 100);
+    text.push_back('0' + n / 10 % 10);
+    text.push_back('0' + n % 10);
+}
+
+void Generator::key(vector<uint32_t>& text, int k, bool swu)
+{
+    if (swu)
+    {
+        text.push_back(0x40001 + k);
+        return;
+    }
+    const char digits[] = "0123456789abcdef";
+    int base = 0x100 + k / 96;
+    text.push_back('S');
+    text.push_back(digits[base >> 8]);
+    text.push_back(digits[(base >> 4) & 15]);
+    text.push_back(digits[base & 15]);
+    text.push_back(digits[k % 96 / 16]);
+    text.push_back(digits[k % 16]);
+}
+
+void Generator::word(vector<uint32_t>& text, const Word& w, bool swu, bool prefixed)
+{
+    if (prefixed)
+    {
+        text.push_back(swu ? 0x1d800 : 'A');
+        for (size_t i = 0; i < w.prefix.size(); i++)
+            key(text, w.prefix[i], swu);
+    }
+    const char lanes[] = "BLMR";
+    if (swu)
+        text.push_back(0x1d801 + static_cast<uint32_t>(strchr(lanes, w.lane) - lanes));
+    else
+        text.push_back(w.lane);
+    number(text, w.width, swu);
+    if (!swu)
+        text.push_back('x');
+    number(text, w.height, swu);
+    for (size_t i = 0; i < w.symbols.size(); i++)
+    {
+        key(text, w.symbols[i].key, swu);
+        number(text, w.symbols[i].x, swu);
+        if (!swu)
+            text.push_back('x');
+        number(text, w.symbols[i].y, swu);
+    }
+}
+
+void Generator::punctuation(vector<uint32_t>& text, bool swu)
+{
+    key(text, between(0x387 - 0x100, 0x38b - 0x100) * 96 + between(0, 5) * 16 + between(0, 15), swu);
+    number(text, between(490, 510), swu);
+    if (!swu)
+        text.push_back('x');
+    number(text, between(490, 510), swu);
+}
+
+// A few words of the sort of LaTeX that sits around the signs, capitals and
+// all, since those are what make us stop and look for a sign.
+void Generator::prose(vector<uint32_t>& text)
+{
+    static const char* const words[] =
+    {
+        "the", "sign", "for", "HOUSE", "is", "made", "with", "both", "hands", "\\textbf{Lesson}",
+        "of", "and", "a", "Deaf", "ASL", "\\emph{flat}", "Mother", "Rain", "Sun", "in",
+        "\\section{Signs}", "LSF", "Both", "Left", "Right", "\\\\", "we", "see", "Signing", "that",
+    };
+    int count = between(4, 12);
+    for (int i = 0; i < count; i++)
+    {
+        for (const char* c = words[random() % 30]; *c != 0; c++)
+            text.push_back(static_cast<uint8_t>(*c));
+        text.push_back(random() % 10 == 0 ? '\n' : ' ');
+    }
+}
+
+vector<uint32_t> Generator::make(const Corpus& corpus, size_t size)
+{
+    vector<uint32_t> text;
+    size_t signBytes = 0;
+    size_t entry = 0;
+    while (text.size() < size)
+    {
+        if (signBytes * 100 >= text.size() * corpus.signShare)
+        {
+            prose(text);
+            continue;
+        }
+        bool swu = static_cast<int>(random() % 100) < corpus.swuShare;
+        size_t before = text.size();
+        if (corpus.glossary)
+        {
+            ostringstream item;
+            item << "\\item gloss" << entry++ << " & ";
+            string s = item.str();
+            text.insert(text.end(), s.begin(), s.end());
+            before = text.size();
+        }
+        if (random() % 32 == 0)
+        {
+            punctuation(text, swu);
+        }
+        else
+        {
+            // Some signs come up far more often than others.
+            size_t pick = random() % vocabularySize * (random() % vocabularySize) / vocabularySize;
+            word(text, vocabulary[pick], swu, static_cast<int>(random() % 100) < corpus.prefixShare);
+        }
+        signBytes += text.size() - before;
+        if (corpus.glossary)
+        {
+            text.push_back(' ');
+            text.push_back('\\');
+            text.push_back('\\');
+            text.push_back('\n');
+        }
+        else
+        {
+            text.push_back(random() % 4 == 0 ? '\n' : ' ');
+        }
+    }
+    text.push_back('\n');
+    return text;
+}
+
+string toUtf8(const vector<uint32_t>& text)
+{
+    string bytes;
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t c = text[i];
+        if (c < 0x80)
+        {
+            bytes += static_cast<char>(c);
+        }
+        else if (c < 0x800)
+        {
+            bytes += static_cast<char>(0xc0 | c >> 6);
+            bytes += static_cast<char>(0x80 | (c & 0x3f));
+        }
+        else if (c < 0x10000)
+        {
+            bytes += static_cast<char>(0xe0 | c >> 12);
+            bytes += static_cast<char>(0x80 | (c >> 6 & 0x3f));
+            bytes += static_cast<char>(0x80 | (c & 0x3f));
+        }
+        else
+        {
+            bytes += static_cast<char>(0xf0 | c >> 18);
+            bytes += static_cast<char>(0x80 | (c >> 12 & 0x3f));
+            bytes += static_cast<char>(0x80 | (c >> 6 & 0x3f));
+            bytes += static_cast<char>(0x80 | (c & 0x3f));
+        }
+    }
+    return bytes;
+}
+
+string toUtf16le(const vector<uint32_t>& text)
+{
+    string bytes = "\xff\xfe";
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        uint32_t c = text[i];
+        uint16_t units[2];
+        int count = 1;
+        if (c < 0x10000)
+        {
+            units[0] = static_cast<uint16_t>(c);
+        }
+        else
+        {
+            units[0] = static_cast<uint16_t>(0xd800 + ((c - 0x10000) >> 10));
+            units[1] = static_cast<uint16_t>(0xdc00 + ((c - 0x10000) & 0x3ff));
+            count = 2;
+        }
+        for (int j = 0; j < count; j++)
+        {
+            bytes += static_cast<char>(units[j] & 0xff);
+            bytes += static_cast<char>(units[j] >> 8);
+        }
+    }
+    return bytes;
+}
+
+// Somewhere for the output to go that costs as little as possible, so that
+// we time the converter and not the disk.
+class Nowhere : public streambuf
+{
+protected:
+    streamsize xsputn(const char*, streamsize count) { return count; }
+    int overflow(int c) { return c == EOF ? 0 : c; }
+};
+
+// What we found, to go in the table and the results file.
+struct Result
+{
+    string benchmark;
+    string corpus;
+    size_t bytes;
+    size_t signs;
+    double seconds;
+};
+
+typedef chrono::steady_clock Clock;
+
+double since(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+void countSign(const Sign&, const string&, void* context)
+{
+    (*static_cast<size_t*>(context))++;
+}
+
+double timeParse(const string& bytes, int repeat, size_t& signs)
+{
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        Converter converter((Options()));
+        signs = 0;
+        converter.onSign(countSign, &signs);
+        Clock::time_point start = Clock::now();
+        converter.begin(0);
+        converter.feed(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        converter.finish();
+        double seconds = since(start);
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+// Keep every sign, to be written again by timeEmit.
+void keepSign(const Sign& sign, const string&, void* context)
+{
+    static_cast<vector<Sign>*>(context)->push_back(sign);
+}
+
+double timeDecode(const string& bytes, int repeat)
+{
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        Converter converter((Options()));
+        Clock::time_point start = Clock::now();
+        converter.benchDecode(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+        double seconds = since(start);
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+double timeEmit(const vector<Sign>& signs, int repeat)
+{
+    Nowhere nowhere;
+    ostream out(&nowhere);
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        Converter converter((Options()));
+        Clock::time_point start = Clock::now();
+        converter.begin(&out);
+        for (size_t i = 0; i < signs.size(); i++)
+            converter.benchWrite(signs[i]);
+        converter.finish();
+        double seconds = since(start);
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+double timeConvert(const string& bytes, const Options& options, int repeat, size_t& signs)
+{
+    Nowhere nowhere;
+    ostream out(&nowhere);
+    double best = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        Converter converter(options);
+        Clock::time_point start = Clock::now();
+        converter.fswtotex(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size(), &out);
+        double seconds = since(start);
+        signs = converter.counts().words;
+        if (r == 0 || seconds < best)
+            best = seconds;
+    }
+    return best;
+}
+
+void report(ostream& out, const Result& result, bool table)
+{
+    double megabytes = result.bytes / (1024.0 * 1024.0);
+    double rate = result.seconds > 0 ? megabytes / result.seconds : 0;
+    double signRate = result.seconds > 0 ? result.signs / result.seconds : 0;
+    if (table)
+    {
+        out << left << setw(18) << result.benchmark << setw(10) << result.corpus << right
+            << setw(10) << result.bytes << setw(9) << result.signs
+            << fixed << setprecision(4) << setw(10) << result.seconds
+            << setprecision(1) << setw(9) << rate << setprecision(0) << setw(12) << signRate << endl;
+    }
+    else
+    {
+        out << result.benchmark << "\t" << result.corpus << "\t" << result.bytes << "\t" << result.signs
+            << "\t" << fixed << setprecision(6) << result.seconds << "\t" << setprecision(2) << rate
+            << "\t" << setprecision(0) << signRate << endl;
+    }
+}
+
+int usage()
+{
+    cout << "This is fswbench, which times fswtotex on made-up text." << endl;
+    cout << endl;
+    cout << "--size <number>      Make each corpus about this many megabytes (1 by default)." << endl;
+    cout << "--repeat <number>    Run everything this many times and keep the fastest (3 by default)." << endl;
+    cout << "--results <file>     Also write the results to this file, a line to a benchmark with" << endl;
+    cout << "                     tabs between the columns, to compare one build with another." << endl;
+    cout << "--generate <corpus>  Don't time anything, just write the named corpus (prose, mixed," << endl;
+    cout << "                     glossary, swu or spelling) to standard out." << endl;
+    cout << "--encoding <name>    Write it in utf8 (the default) or utf16le." << endl;
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    double megabytes = 1;
+    int repeat = 3;
+    string resultsName;
+    string generated;
+    string encoding = "utf8";
+    for (int i = 1; i < argc; i++)
+    {
+        string argument = argv[i];
+        if (i + 1 >= argc)
+            return usage();
+        if (argument == "--size")
+            megabytes = atof(argv[++i]);
+        else if (argument == "--repeat")
+            repeat = atoi(argv[++i]);
+        else if (argument == "--results")
+            resultsName = argv[++i];
+        else if (argument == "--generate")
+            generated = argv[++i];
+        else if (argument == "--encoding")
+            encoding = argv[++i];
+        else
+            return usage();
+    }
+    if (megabytes <= 0 || repeat < 1 || (encoding != "utf8" && encoding != "utf16le"))
+        return usage();
+    size_t size = static_cast<size_t>(megabytes * 1024 * 1024);
+    size_t corpusCount = sizeof(corpora) / sizeof(corpora[0]);
+
+    if (!generated.empty())
+    {
+        for (size_t c = 0; c < corpusCount; c++)
+        {
+            if (generated == corpora[c].name)
+            {
+                Generator generator;
+                vector<uint32_t> text = generator.make(corpora[c], size);
+                cout << (encoding == "utf8" ? toUtf8(text) : toUtf16le(text));
+                return 0;
+            }
+        }
+        return usage();
+    }
+
+    // The options that change what gets written, each timed on every corpus.
+    struct Mode
+    {
+        const char* name;
+        Options options;
+    };
+    vector<Mode> modes(6);
+    modes[0].name = "default";
+    modes[1].name = "compact";
+    modes[1].options.compact = true;
+    modes[2].name = "merge";
+    modes[2].options.merge = true;
+    modes[3].name = "ptsize";
+    modes[3].options.ptsize = 12;
+    modes[4].name = "spelling";
+    modes[4].options.spelling = true;
+    modes[5].name = "savebox";
+    modes[5].options.savebox = true;
+
+    vector<Result> results;
+    cout << left << setw(18) << "benchmark" << setw(10) << "corpus" << right << setw(10) << "bytes"
+        << setw(9) << "signs" << setw(10) << "seconds" << setw(9) << "MB/s" << setw(12) << "signs/s" << endl;
+    try
+    {
+        for (size_t c = 0; c < corpusCount; c++)
+        {
+            Generator generator;
+            vector<uint32_t> text = generator.make(corpora[c], size);
+            string utf8 = toUtf8(text);
+            string utf16 = toUtf16le(text);
+            string name = corpora[c].name;
+            size_t signs = 0;
+
+            Result parse = { "parse", name, utf8.size(), 0, timeParse(utf8, repeat, signs) };
+            parse.signs = signs;
+            Result wideParse = { "parse-utf16le", name, utf16.size(), 0, timeParse(utf16, repeat, signs) };
+            wideParse.signs = signs;
+            Result decode = { "decode-utf16le", name, utf16.size(), 0, timeDecode(utf16, repeat) };
+            vector<Sign> read;
+            Converter reader((Options()));
+            reader.onSign(keepSign, &read);
+            reader.begin(0);
+            reader.feed(reinterpret_cast<const uint8_t*>(utf8.data()), utf8.size());
+            reader.finish();
+            Result emit = { "emit", name, utf8.size(), read.size(), timeEmit(read, repeat) };
+            results.push_back(parse);
+            results.push_back(wideParse);
+            results.push_back(decode);
+            results.push_back(emit);
+            for (size_t m = 0; m < modes.size(); m++)
+            {
+                Result whole = { string("convert-") + modes[m].name, name, utf8.size(), 0, 0 };
+                whole.seconds = timeConvert(utf8, modes[m].options, repeat, signs);
+                whole.signs = signs;
+                results.push_back(whole);
+            }
+            Result wide = { "convert-utf16le", name, utf16.size(), 0, timeConvert(utf16, modes[0].options, repeat, signs) };
+            wide.signs = signs;
+            results.push_back(wide);
+            for (size_t r = results.size() - modes.size() - 5; r < results.size(); r++)
+                report(cout, results[r], true);
+        }
+    }
+    catch (char const* message)
+    {
+        cout << "Failure: " << message << endl;
+        return -1;
+    }
+
+    if (!resultsName.empty())
+    {
+        ofstream resultsFile(resultsName);
+        if (!resultsFile)
+        {
+            cout << "Couldn't write " << resultsName << endl;
+            return -1;
+        }
+        resultsFile << "benchmark\tcorpus\tbytes\tsigns\tseconds\tMB/s\tsigns/s" << endl;
+        for (size_t r = 0; r < results.size(); r++)
+            report(resultsFile, results[r], false);
+    }
+    return 0;
+}
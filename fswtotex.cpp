@@ -1,608 +1,808 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
-using namespace std;
-
-/*
-    This parser works with as state machines within state machines.
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
-    There is also a general error state which says that we failed in our matching and need
-    to spit out what we have saved so far.
+#include "fswtotex.h"
 
-    Our outer state machine has the following states:
-        Start       -- the obligatory starting state
-        Punctuation -- processing a punctuation sign (can be done visually as well)
-        Prefix      -- processing the temporal prefix (can be missing)
-        Visual      -- processing the visual layout of the sign (required)
-        End         -- Time to spit out what we have
+using namespace std;
+using namespace fswtotex;
 
-    The Punctuation state machine has the following states:
-        Symbol      -- processing a base symbol
-        Placement   -- processing the placement of the symbol
-        End         -- Time for the outer state machine to finish
+/*
+    Once a converter has warmed up, converting another word shouldn't need
+    any memory it doesn't already have. To be able to check that, every
+    allocation in the program goes through this counter, and --stats reports
+    how many happened during the conversion. They are kept out of line, or
+    the compiler sees malloc and free through them and mistakes the pairs.
+*/
 
-    The prefix state machine has the following states:
-        Start       -- the obligatory starting state
-        Symbol      -- processing a base symbol
-        End         -- If we used this state machine, time for the outer state machine to move to the next state
+atomic<size_t> allocations(0);
 
-    The visual state machine has the following states:
-        Start       -- the obligatory starting state
-        Size        -- processing the size of the word
-        Symbol      -- processing a base symbol
-        Placement   -- processing the placement of the symbol
-        End         -- Time for the outer state machine to finish
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocations.fetch_add(1, memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (p == 0)
+        throw bad_alloc();
+    return p;
+}
 
-    The Symbol state machine has the following states
-        Start       -- the obligatory starting state
-        FirstDigit  -- the first digit
-        SecondDigit -- the second digit
-        ThirdDigt   -- the third digit
-        Fill        -- the fill
-        Rotation    -- the rotation
-        End         -- Time for the outer state machine to finish
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    free(p);
+}
 
-    The Size state machine has the following states:
-        Start       -- the obligatory starting state
-        FirstW      -- the first digit of the width
-        SecondW     -- the second digit of the width
-        ThirdW      -- the third digit of the width
-        x           -- the letter `x'
-        FirstH      -- the first digit of the height
-        SecondH     -- the second digit of the height
-        ThirdH      -- the third digit of the height
-        End         -- Time for the outer state machine to finish
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
 
-    The Placement state machine is exactly the same as the size state machine
-*/
+// Finally, let's explain and start the program
 
-const int s_error = -1;
-const int s_start = 0;
-const int s_punctuation = 1;
-const int s_prefix = 2;
-const int s_visual = 3;
-const int s_size = 1;
-const int s_symbol = 2;
-const int s_placement = 3;
-const int s_first = 1;
-const int s_second = 2;
-const int s_third = 3;
-const int s_fill = 4;
-const int s_rotation = 5;
-const int s_firstw = 1;
-const int s_secondw = 2;
-const int s_thirdw = 3;
-const int s_x = 4;
-const int s_firsth = 5;
-const int s_secondh = 6;
-const int s_thirdh = 7;
-const int s_end = 8;
+int usage()
+{
+    cout << "This is fswtotex." << endl;
+    cout << endl;
+    cout << "This program runs in one of three ways." << endl;
+    cout << "If you provide no arguments, we read from standard in and send the results to standard out." << endl;
+    cout << "If you provide one argument, we read from that file and send the results to standard out." << endl;
+    cout << "If you provide two arguments, we read from the first file and send the results to the second file." << endl;
+    cout << "With --batch or --manifest, we convert any number of files into others, several at once." << endl;
+    cout << endl;
+    cout << "So what do we do?" << endl;
+    cout << endl;
+    cout << "We read LaTeX code with embedded SignWriting words (see http://signwriting.org) and output LaTeX "
+        "code with TiKz drawings of SignWriting symbols." << endl;
+    cout << endl;
+    cout << "There are a few modifications you can take advantage of though:" << endl;
+    cout << "--fsize <string>  By default we assume a string called f@size holds the size which is" << endl;
+    cout << "                  generally a usable value to use in LaTex documents. You can change" << endl;
+    cout << "                  this if (for instance) you want SignWriting text to be a different" << endl;
+    cout << "                  size or you already have some other length being used. Fswtotex does" << endl;
+    cout << "                  add a \\ in front of the string you provide." << endl;
+    cout << "--nomirror        By default we mirror, this turns that off." << endl;
+    cout << "--rotate <number> By default we assume a value of -90. The reason we default to mirrored" << endl;
+    cout << "                  and rotated by -90 degrees pages is because SignWriting is a vertical" << endl;
+    cout << "                  writing system. By rotating the page by -90 degrees we turn horizontal" << endl;
+    cout << "                  lines into vertical columns. But this alone would make for columns of" << endl;
+    cout << "                  text moving from right to left, so by adding a mirror to the text we" << endl;
+    cout << "                  get vertial columns of text moving from left to right. The next most" << endl;
+    cout << "                  likely settings you may want would be --nomirror --rotate 0, as this" << endl;
+    cout << "                  allows for insertion of SignWriting in the midst of English text but" << endl;
+    cout << "                  does require the author to handle things like placing the text into" << endl;
+    cout << "                  a multi-column environment and adding linebreaks after each word." << endl;
+    cout << "--spelling        By default, we don't spell. If this option is added then columns of" << endl;
+    cout << "                  of symbols will appear above the word if it has a time domain prefix." << endl;
+    cout << "--compact         Define a few macros once and write each word with them instead of" << endl;
+    cout << "                  writing out every TikZ command in full. The macros are among the" << endl;
+    cout << "                  suggestions at the end of the output. This makes for much smaller" << endl;
+    cout << "                  files that xelatex gets through faster." << endl;
+    cout << "--merge           Draw each symbol as one node holding both the fill and the line" << endl;
+    cout << "                  glyph, rather than as two nodes at the same spot. This looks the" << endl;
+    cout << "                  same and halves the number of nodes xelatex has to build." << endl;
+    cout << "--ptsize <number> Take the font size to be this many points and write every position as" << endl;
+    cout << "                  a plain length, rather than leaving xelatex to work each one out" << endl;
+    cout << "                  from \\f@size (or the --fsize length). Only use this when the text" << endl;
+    cout << "                  really is that size." << endl;
+    cout << "--cache <dir>     Keep the translation of every word in this directory, and use what" << endl;
+    cout << "                  earlier runs kept there, so that converting the same words again" << endl;
+    cout << "                  is mostly a matter of reading them back. Any number of runs can" << endl;
+    cout << "                  share the directory, and it is made if it doesn't exist." << endl;
+    cout << "--savebox         Build each sign that comes up more than once into a box the first" << endl;
+    cout << "                  time, and use the box from then on, so that xelatex only has to" << endl;
+    cout << "                  draw it once. This reads the input twice. The box is the size the" << endl;
+    cout << "                  sign was where it first appears, so don't use this if the same sign" << endl;
+    cout << "                  comes up at different sizes (in a footnote or a heading, say)." << endl;
+    cout << "--incremental     Keep an index beside the output file of what each part of the input" << endl;
+    cout << "                  turned into, and next time only convert the parts that changed." << endl;
+    cout << "                  This needs both an input and an output file." << endl;
+    cout << "--batch           Every argument that isn't an option is a pair of files, written as" << endl;
+    cout << "                  input:output, and we convert each input into its output. If one" << endl;
+    cout << "                  of them fails, we say so and carry on with the rest." << endl;
+    cout << "--manifest <file> The same as --batch, but the pairs are read from this file, one to a" << endl;
+    cout << "                  line." << endl;
+    cout << "--jobs <number>   With --batch or --manifest, how many files to convert at once, and" << endl;
+    cout << "                  otherwise, how many threads to convert a big file on. By default" << endl;
+    cout << "                  we use every processor." << endl;
+    cout << "--pipeline        Read, convert and write on three threads, so that a slow input or" << endl;
+    cout << "                  output doesn't hold up the conversion. A file converted this way" << endl;
+    cout << "                  isn't split across --jobs threads." << endl;
+    cout << "--serve <socket>  Keep running, and convert whatever is sent to this Unix socket by" << endl;
+    cout << "                  --client. The options given here are only the defaults for" << endl;
+    cout << "                  --cache; each request brings its own options." << endl;
+    cout << "--client <socket> Have the --serve at this socket do the conversion, which saves us" << endl;
+    cout << "                  getting started every time. If nothing answers, we do it ourselves." << endl;
+    cout << "--watch <dir>     Keep running, and whenever a file in this directory whose name ends" << endl;
+    cout << "                  in .sw.tex is saved, convert it into the same name ending in .tex." << endl;
+    cout << "                  Files that are newer than what they were converted into are" << endl;
+    cout << "                  converted straight away." << endl;
+    cout << "--stats           When we are done, report on standard error how many words we converted," << endl;
+    cout << "                  how many times we had to allocate memory to do it, and how often a" << endl;
+    cout << "                  word was one we had already translated." << endl;
+    return 0;
+}
 
-int state = s_start;
-int substate = s_start;
-int subsubstate = s_start;
+// The note at the end of every output, so anyone can see how to make it again.
+void writeTrailer(ostream& out, int argc, char** argv)
+{
+    out << "% This file was generated by:" << endl;
+    out << "%    ";
+    for (int i = 0; i < argc; i++)
+        out << argv[i] << " ";
+    out << endl;
+}
+
+// A file that is removed again when we leave, unless it has been kept, so
+// that a failure part way through doesn't leave it lying around.
+struct TemporaryFile
+{
+    string name;
+    bool kept = false;
+
+    ~TemporaryFile()
+    {
+        if (!name.empty() && !kept)
+            remove(name.c_str());
+    }
+};
+
+// Read all of a file.
+void readFile(const string& fileName, string& text)
+{
+    ifstream fin(fileName, ios::in | ios::binary);
+    if (!fin)
+        throw "Unable to open the input file.";
+    text.assign(istreambuf_iterator<char>(fin), istreambuf_iterator<char>());
+    if (fin.bad())
+        throw "Unable to read the input file.";
+}
+
+// Temporary outputs made so far, so that no two threads pick the same name.
+atomic<size_t> temporaries(0);
+
+// Convert one file into another. This is how two file names are handled,
+// and also every pair in a batch. The input is mapped, unless it is to be
+// read in first, for a file somebody else may rewrite while we convert it.
+// The output is written beside the real one and only put in its place once
+// it is all there, so a failure (a missing input, say) leaves whatever was
+// there before as it was.
+void convertFile(Converter& converter, const Options& options, const string& inName,
+    const string& outName, int argc, char** argv, bool readIn = false)
+{
+    string text;
+    if (readIn)
+        readFile(inName, text);
+    else if (access(inName.c_str(), R_OK) != 0)
+        throw "Unable to open the input file.";
+    // With --incremental we also read from the old output as we go.
+    if (options.incremental)
+        converter.loadIndex(outName);
+    TemporaryFile temporary;
+    temporary.name = outName + "." + to_string(getpid()) + "." + to_string(temporaries++) + ".tmp";
+    fstream fout;
+    fout.open(temporary.name, ios::out);
+    if (!fout)
+        throw "Unable to open the output file.";
+    if (readIn)
+        converter.fswtotex(reinterpret_cast<const uint8_t*>(text.data()), text.size(), &fout);
+    else
+        converter.fswtotex(inName, &fout);
+    writeTrailer(fout, argc, argv);
+    fout.close();
+    if (!fout || rename(temporary.name.c_str(), outName.c_str()) != 0)
+        throw "Unable to write the output file.";
+    temporary.kept = true;
+    if (options.incremental)
+        converter.saveIndex(outName);
+}
 
 /*
-    Now we come to reading.
-
-    If we want to be able to read from a wide variety of files, then we
-    have to be ready for all the different encodings and be able to convert
-    each of them into utf-32.
-
-    We will begin here with a set of functions to read a character of a
-    given type. Unknown or undetermined as of yet and utf8/16/32/le/be. We
-    will then have a set of functions to convert to utf32(internal version)
-    from all the other types of characters.
-
-    Even though these are technically characters, because we are dealing
-    with SignWriting characters which are outside of plane-0 we are going
-    to pass them around as if they are unsigned integers anyway.
+    A batch is a list of files to convert, shared by a few threads. Each
+    thread has a converter of its own and takes the next file off the list
+    until there are none left. A file that fails only has its failure
+    noted, and the thread goes on to the next one; the failures are all
+    reported once everything is done, in the order the files were given.
 */
 
-enum theTextFormat
+struct Job
 {
-    unknown, utf8, utf16le, utf16be, utf32le, utf32be
-} textFormat = unknown;
+    string inName;
+    string outName;
+    const char* failure = 0;
+};
 
-uint32_t getChar(istream* fileIn);
-
-uint32_t getCharUnknown(istream* fileIn);
-uint32_t getCharUtf8(istream* fileIn);
-uint32_t getCharUtf16le(istream* fileIn);
-uint32_t getCharUtf16be(istream* fileIn);
-uint32_t getCharUtf32le(istream* fileIn);
-uint32_t getCharUtf32be(istream* fileIn);
+struct Batch
+{
+    Options options;
+    vector<Job> jobs;
+    atomic<size_t> next{0};
+    mutex lock;
+    Counts counted;
+    int argc = 0;
+    char** argv = 0;
+};
 
-int utf8ToUtf32(uint8_t* c, uint32_t* fileOut);
-int utf16leToUtf32(uint8_t* c, uint32_t* fileOut);
-int utf16beToUtf32(uint8_t* c, uint32_t* fileOut);
-int utf32leToUtf32(uint8_t* c, uint32_t* fileOut);
-int utf32beToUtf32(uint8_t* c, uint32_t* fileOut);
+// Split input:output into its two files.
+bool addJob(Batch& batch, const string& pair)
+{
+    size_t colon = pair.find(':');
+    if (colon == string::npos || colon == 0 || colon + 1 == pair.size())
+        return false;
+    Job job;
+    job.inName = pair.substr(0, colon);
+    job.outName = pair.substr(colon + 1);
+    batch.jobs.push_back(job);
+    return true;
+}
 
-uint32_t getCharUnknown(istream* fileIn)
+void runJobs(Batch* batch)
 {
-    uint32_t result = 0;
-    // feff is the byte order
-    // In each format, this can serve as a key
-    // utf  8    ef bb bf
-    // utf 16 le ff fe
-    // utf 16 be fe ff
-    // utf 32 le ff fe 00 00
-    // utf 32 be 00 00 fe ff
-    // So if we are unknown then we look for those,
-    // and if we don't see any of them we default to utf8
-    static uint8_t charBuff[4] = { 0, 0, 0, 0 };
-    static int charBuffSize = 0;
-    if (charBuffSize == 0)
+    Converter converter(batch->options);
+    converter.loadCache();
+    Counts counted;
+    for (size_t i = batch->next++; i < batch->jobs.size(); i = batch->next++)
     {
-        for (; charBuffSize < 4; charBuffSize++)
-        {
-            charBuff[charBuffSize] = static_cast<uint8_t>(fileIn->get());
-        }
-        if (charBuff[0] == 0x0 && charBuff[1] == 0x0 &&
-            charBuff[2] == 0xfe && charBuff[3] == 0xff)
-        {
-            textFormat = utf32be;
-            return getCharUtf32be(fileIn);
-        }
-        else if (charBuff[0] == 0xff && charBuff[1] == 0xfe &&
-            charBuff[2] == 0x0 && charBuff[3] == 0x0)
-        {
-            textFormat = utf32le;
-            return getCharUtf32le(fileIn);
-        }
-        else if (charBuff[0] == 0xfe && charBuff[1] == 0xff)
+        Job& job = batch->jobs[i];
+        try
         {
-            textFormat = utf16be;
-            charBuff[0] = charBuff[2];
-            charBuff[1] = charBuff[3];
-            charBuff[2] = 0;
-            charBuff[3] = 0;
-            if (utf16beToUtf32(charBuff, &result) == 2)
-            {
-                return result;
-            }
-            charBuff[2] = static_cast<uint8_t>(fileIn->get());
-            charBuff[3] = static_cast<uint8_t>(fileIn->get());
-            if (utf16beToUtf32(charBuff, &result) == 4)
-            {
-                return result;
-            }
-            throw "Badly formed utf16be string.";
+            convertFile(converter, batch->options, job.inName, job.outName, batch->argc, batch->argv);
+            // A file that failed may not have got as far as starting, and
+            // then the counts are still those of the file before it.
+            counted.words += converter.counts().words;
+            counted.hits += converter.counts().hits;
+            counted.misses += converter.counts().misses;
         }
-        else if (charBuff[0] == 0xff && charBuff[1] == 0xfe)
+        catch (char const* message)
         {
-            textFormat = utf16le;
-            charBuff[0] = charBuff[2];
-            charBuff[1] = charBuff[3];
-            charBuff[2] = 0;
-            charBuff[3] = 0;
-            if (utf16leToUtf32(charBuff, &result) == 2)
-            {
-                return result;
-            }
-            charBuff[2] = static_cast<uint8_t>(fileIn->get());
-            charBuff[3] = static_cast<uint8_t>(fileIn->get());
-            if (utf16leToUtf32(charBuff, &result) == 4)
-            {
-                return result;
-            }
-            throw "Badly formed ut16le string.";
+            job.failure = message;
         }
-        else if (charBuff[0] == 0xef && charBuff[1] == 0xbb &&
-            charBuff[2] == 0xbf)
+        catch (...)
         {
-            textFormat = utf8;
-            charBuff[0] = charBuff[3];
-            charBuff[1] = 0;
-            charBuff[2] = 0;
-            charBuff[3] = 0;
-            if (utf8ToUtf32(charBuff, &result) == 1)
-            {
-                return result;
-            }
-            charBuff[1] = static_cast<uint8_t>(fileIn->get());
-            if (utf8ToUtf32(charBuff, &result) == 2)
-            {
-                return result;
-            }
-            charBuff[2] = static_cast<uint8_t>(fileIn->get());
-            if (utf8ToUtf32(charBuff, &result) == 3)
-            {
-                return result;
-            }
-            charBuff[3] = static_cast<uint8_t>(fileIn->get());
-            if (utf8ToUtf32(charBuff, &result) == 4)
-            {
-                return result;
-            }
-            throw "Badly formed utf8 string.";
+            job.failure = "Unexpected failure.";
         }
     }
-    int offset = utf8ToUtf32(charBuff, &result);
-    while (offset < 0 && charBuffSize < 4)
-    {
-        charBuff[charBuffSize] = static_cast<uint8_t>(fileIn->get());
-        charBuffSize++;
-        offset = utf8ToUtf32(charBuff, &result);
-    }
-    int i;
-    for (i = 0; i < charBuffSize - offset; i++)
-    {
-        charBuff[i] = charBuff[i + offset];
-    }
-    for (; i < charBuffSize; i++)
+    converter.saveCache();
+    lock_guard<mutex> locked(batch->lock);
+    batch->counted.words += counted.words;
+    batch->counted.hits += counted.hits;
+    batch->counted.misses += counted.misses;
+}
+
+int runBatch(Batch& batch, size_t threads, bool stats)
+{
+    size_t allocated = allocations;
+    if (threads > batch.jobs.size())
+        threads = batch.jobs.size();
+    vector<thread> running;
+    for (size_t i = 1; i < threads; i++)
+        running.push_back(thread(runJobs, &batch));
+    runJobs(&batch);
+    for (size_t i = 0; i < running.size(); i++)
+        running[i].join();
+
+    int result = 0;
+    for (size_t i = 0; i < batch.jobs.size(); i++)
     {
-        charBuff[i] = 0;
+        if (batch.jobs[i].failure != 0)
+        {
+            cout << "Failure: " << batch.jobs[i].inName << ": " << batch.jobs[i].failure << endl;
+            result = -1;
+        }
     }
-    charBuffSize -= offset;
-    if (charBuffSize == 0)
+    if (stats)
     {
-        textFormat = utf8;
+        cerr << "Converted " << batch.counted.words << " words in " << batch.jobs.size() << " files with "
+            << (allocations - allocated) << " allocations." << endl;
+        cerr << "Word cache: " << batch.counted.hits << " hits, " << batch.counted.misses << " misses." << endl;
     }
     return result;
 }
 
-uint32_t getCharUtf8(istream* fileIn)
+/*
+    Starting a process for every few words (an editor showing a preview as
+    you type) spends more time starting up than converting. With --serve,
+    we stay running and convert whatever is sent to a Unix socket, keeping
+    a converter for each set of options, with its cache, from one request
+    to the next. With --client, we send our input to that socket rather
+    than converting it ourselves, and if nobody is listening, convert it
+    ourselves after all. Either way the output is the same.
+
+    A request is the length of the options (as a uint32_t), the options,
+    and then the text, up until the client shuts down its side of the
+    socket. The reply is one byte, 0 if the conversion went well and 1 if
+    not, then if it didn't, the length of the failure and the failure, and
+    then whatever output there was. Requests are taken one at a
+    time, so a client gets a few seconds in all to send its request, and
+    as long again to take the reply, before we give up on it and move on
+    to the next. Whatever goes wrong with one request is only reported to
+    its client.
+*/
+
+const int requestSeconds = 5;
+
+// The options that change what a conversion writes, one to a line.
+string encodeOptions(const Options& options)
 {
-    uint8_t charBuff[4] = { 0,0,0,0 };
-    int read = 0;
-    int size = 0;
-    uint32_t result = 0;
-    do
-    {
-        read = (fileIn->get());
-        if (read == -1)
-            return 0xffffffff;
-        charBuff[size++] = static_cast<uint8_t>(read);
-    } while ((size < 4) && (utf8ToUtf32(charBuff, &result) != size));
-    if (utf8ToUtf32(charBuff, &result) == size)
+    char ptsize[32];
+    snprintf(ptsize, sizeof(ptsize), "%.17g", options.ptsize);
+    return "fsize " + options.fsize + "\nmirror " + to_string(options.mirror) +
+        "\nrotation " + to_string(options.rotation) + "\nspelling " + to_string(options.spelling) +
+        "\ncompact " + to_string(options.compact) + "\nmerge " + to_string(options.merge) +
+        "\nptsize " + ptsize + "\nsavebox " + to_string(options.savebox) + "\n";
+}
+
+void decodeOptions(const string& encoded, Options& options)
+{
+    size_t place = 0;
+    while (place < encoded.size())
     {
-        return result;
+        size_t space = encoded.find(' ', place);
+        size_t end = encoded.find('\n', place);
+        if (space == string::npos || end == string::npos || space > end)
+            throw "Badly formed request.";
+        string name = encoded.substr(place, space - place);
+        string value = encoded.substr(space + 1, end - space - 1);
+        if (name == "fsize")
+            options.fsize = value;
+        else if (name == "mirror")
+            options.mirror = value == "1";
+        else if (name == "rotation")
+            options.rotation = atoi(value.c_str());
+        else if (name == "spelling")
+            options.spelling = value == "1";
+        else if (name == "compact")
+            options.compact = value == "1";
+        else if (name == "merge")
+            options.merge = value == "1";
+        else if (name == "ptsize")
+            options.ptsize = atof(value.c_str());
+        else if (name == "savebox")
+            options.savebox = value == "1";
+        place = end + 1;
     }
-    throw "Badly formed utf8 string.";
 }
 
-uint32_t getCharUtf16le(istream* fileIn)
+bool sendAll(int fd, const char* bytes, size_t size)
 {
-    uint8_t charBuff[4] = { 0,0,0,0 };
-    int read = 0;
-    int size = 0;
-    uint32_t result = 0;
-    do
-    {
-        read = (fileIn->get());
-        if (read == -1)
-            return 0xffffffff;
-        charBuff[size++] = static_cast<uint8_t>(read);
-        read = (fileIn->get());
-        if (read == -1)
-            return 0xffffffff;
-        charBuff[size++] = static_cast<uint8_t>(read);
-    } while ((size < 4) && (utf16leToUtf32(charBuff, &result) != size));
-    if (utf16leToUtf32(charBuff, &result) == size)
+    while (size > 0)
     {
-        return result;
+        ssize_t sent = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0)
+            return false;
+        bytes += sent;
+        size -= sent;
     }
-    throw "Badly formed utf16le string.";
+    return true;
 }
 
-uint32_t getCharUtf16be(istream* fileIn)
+// Read until the other side is done. Given some patience (in milliseconds),
+// give up if it isn't done by then, however much it is still sending.
+bool receiveAll(int fd, string& to, int patience = -1)
 {
-    uint8_t charBuff[4] = { 0,0,0,0 };
-    int read = 0;
-    int size = 0;
-    uint32_t result = 0;
-    do
-    {
-        read = (fileIn->get());
-        if (read == -1)
-            return 0xffffffff;
-        charBuff[size++] = static_cast<uint8_t>(read);
-        read = (fileIn->get());
-        if (read == -1)
-            return 0xffffffff;
-        charBuff[size++] = static_cast<uint8_t>(read);
-    } while ((size < 4) && (utf16beToUtf32(charBuff, &result) != size));
-    if (utf16beToUtf32(charBuff, &result) == size)
+    char buffer[64 * 1024];
+    chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::milliseconds(patience);
+    for (;;)
     {
-        return result;
+        if (patience >= 0)
+        {
+            long long left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            pollfd waiting = { fd, POLLIN, 0 };
+            if (left <= 0 || poll(&waiting, 1, static_cast<int>(left)) <= 0)
+                return false;
+        }
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received == 0)
+            return true;
+        if (received < 0)
+            return false;
+        to.append(buffer, received);
     }
-    throw "Badly formed utf16be string.";
 }
 
-uint32_t getCharUtf32le(istream* fileIn)
+sockaddr_un socketAddress(const string& socketName)
 {
-    uint8_t charBuff[4] = { 0,0,0,0 };
-    int read = 0;
-    int size = 0;
-    uint32_t result;
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    utf32leToUtf32(charBuff, &result);
-    return result;
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketName.size() >= sizeof(address.sun_path))
+        throw "The socket name is too long.";
+    memcpy(address.sun_path, socketName.data(), socketName.size());
+    return address;
 }
 
-uint32_t getCharUtf32be(istream* fileIn)
+// Whether the name is a socket, rather than a file or anything else that
+// we have no business removing.
+bool isSocket(const string& socketName)
 {
-    uint8_t charBuff[4] = { 0,0,0,0 };
-    int read = 0;
-    int size = 0;
-    uint32_t result;
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    read = (fileIn->get());
-    if (read == -1)
-        return 0xffffffff;
-    charBuff[size++] = static_cast<uint8_t>(read);
-    utf32beToUtf32(charBuff, &result);
-    return result;
+    struct stat info;
+    return lstat(socketName.c_str(), &info) == 0 && S_ISSOCK(info.st_mode);
 }
 
-uint32_t getChar(istream* fileIn)
+// Whether a server is listening there now.
+bool answered(const sockaddr_un& address)
 {
-    switch (textFormat)
-    {
-    case utf8: return getCharUtf8(fileIn);
-    case utf16le: return getCharUtf16le(fileIn);
-    case utf16be: return getCharUtf16be(fileIn);
-    case utf32le: return getCharUtf32le(fileIn);
-    case utf32be: return getCharUtf32be(fileIn);
-    default: return getCharUnknown(fileIn);
-    }
+    int asking = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (asking < 0)
+        return false;
+    bool connected = connect(asking, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    close(asking);
+    return connected;
 }
 
-/*
-    We always convert to utf-8 on output since we know that we are
-    outputting a lot of XeLaTeX code with expanded characters of the
-    format ``\char#xxxx''.
-*/
+volatile sig_atomic_t running = 1;
 
-string utf32ToUtf8(uint32_t c)
+void stopRunning(int)
 {
-    string to;
-    if (c < 0x80)
-    {
-        to.push_back(static_cast<char>(c));
-    }
-    else if (c < 0x800)
-    {
-        to.push_back(static_cast<char>(((c >> 6) & 0x1f) | 0xc0));
-        to.push_back(static_cast<char>(((c >> 0) & 0x3f) | 0x80));
-    }
-    else if (c < 0x10000)
-    {
-        to.push_back(static_cast<char>(((c >> 12) & 0xf) | 0xe0));
-        to.push_back(static_cast<char>(((c >> 6) & 0x3f) | 0x80));
-        to.push_back(static_cast<char>(((c >> 0) & 0x3f) | 0x80));
-    }
-    else
-    {
-        to.push_back(static_cast<char>(((c >> 18) & 0x7) | 0xf0));
-        to.push_back(static_cast<char>(((c >> 12) & 0x3f) | 0x80));
-        to.push_back(static_cast<char>(((c >> 6) & 0x3f) | 0x80));
-        to.push_back(static_cast<char>(((c >> 0) & 0x3f) | 0x80));
-    }
-    return to;
+    running = 0;
 }
 
-// And now we send it out
-void sendOut(ostream* fileOut, uint32_t c)
+// A converter kept for one set of options, and the request it last served.
+struct Served
 {
-    (*fileOut) << utf32ToUtf8(c);
-}
+    unique_ptr<Converter> converter;
+    size_t used = 0;
+};
+
+typedef unordered_map<string, Served> Converters;
 
-void sendOut(ostream* fileOut, vector<uint32_t>& l, uint32_t c)
+// Every set of options a client asks for gets a converter and a cache of its
+// own, so only so many are kept, and the one used longest ago makes way.
+const size_t maxConverters = 16;
+
+void evictConverter(Converters& converters)
 {
-    for (unsigned int i = 0; i < l.size(); i++)
-        sendOut(fileOut, l[i]);
-    sendOut(fileOut, c);
-    l.clear();
-    state = substate = subsubstate = s_start;
+    Converters::iterator oldest = converters.begin();
+    for (Converters::iterator i = converters.begin(); i != converters.end(); ++i)
+    {
+        if (i->second.used < oldest->second.used)
+            oldest = i;
+    }
+    if (oldest == converters.end())
+        return;
+    if (oldest->second.converter)
+        oldest->second.converter->saveCache();
+    converters.erase(oldest);
 }
 
-// Now that we have been using all those ``convert to uft32'', let's define them.
-
-int utf8ToUtf32(uint8_t* coming, uint32_t* going)
+int serve(const Options& options, const string& socketName)
 {
-    // Quick review:
-    //    0xxx xxxx
-    //    110x xxxx  10xx xxxx
-    //    1110 xxxx  10xx xxxx  10xx xxxx
-    //    1111 -xxx  10xx xxxx  10xx xxxx  10xx xxxx
-    if ((coming[0] & 0xf0) == 0xf0)
+    sockaddr_un address = socketAddress(socketName);
+    int listening = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listening < 0)
+        throw "Unable to make a socket.";
+    // A socket left behind by a server that has gone can be cleared away, but
+    // anything else there is somebody else's.
+    struct stat info;
+    if (lstat(socketName.c_str(), &info) == 0)
     {
-        going[0] = coming[0] & 0x7;
-        for (int i = 1; i < 4; i++)
+        if (!S_ISSOCK(info.st_mode) || answered(address))
         {
-            if ((coming[i] & 0xc0) != 0x80)
-                return 0;
-            going[0] <<= 6;
-            going[0] |= (coming[i] & 0x3f);
+            close(listening);
+            throw "The socket path exists.";
         }
-        return 4;
+        unlink(socketName.c_str());
     }
-    if ((coming[0] & 0xf0) == 0xe0)
+    if (bind(listening, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listening, 16) != 0)
     {
-        going[0] = coming[0] & 0xf;
-        for (int i = 1; i < 3; i++)
-        {
-            if ((coming[i] & 0xc0) != 0x80)
-                return 0;
-            going[0] <<= 6;
-            going[0] |= (coming[i] & 0x3f);
-        }
-        return 3;
+        close(listening);
+        throw "Unable to listen on the socket.";
     }
-    if ((coming[0] & 0xe0) == 0xc0)
+    // Without SA_RESTART, so that a signal gets us out of accept.
+    struct sigaction stopping;
+    memset(&stopping, 0, sizeof(stopping));
+    stopping.sa_handler = stopRunning;
+    sigaction(SIGINT, &stopping, 0);
+    sigaction(SIGTERM, &stopping, 0);
+
+    Converters converters;
+    size_t requests = 0;
+    string request;
+    ostringstream converted;
+    while (running)
     {
-        going[0] = coming[0] & 0x1f;
-        for (int i = 1; i < 2; i++)
+        int client = accept(listening, 0, 0);
+        if (client < 0)
+            continue;
+        // A client that stops reading our reply mustn't hold us up either.
+        timeval patience = { requestSeconds, 0 };
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &patience, sizeof(patience));
+        request.clear();
+        converted.str(string());
+        string failure;
+        uint32_t length = 0;
+        try
+        {
+            if (!receiveAll(client, request, requestSeconds * 1000) || request.size() < sizeof(length))
+                throw "Badly formed request.";
+            memcpy(&length, request.data(), sizeof(length));
+            if (request.size() - sizeof(length) < length)
+                throw "Badly formed request.";
+            string encoded = request.substr(sizeof(length), length);
+            Converters::iterator found = converters.find(encoded);
+            if (found == converters.end())
+            {
+                Options wanted = options;
+                decodeOptions(encoded, wanted);
+                unique_ptr<Converter> made(new Converter(wanted));
+                made->loadCache();
+                if (converters.size() >= maxConverters)
+                    evictConverter(converters);
+                found = converters.emplace(encoded, Served()).first;
+                found->second.converter = move(made);
+            }
+            found->second.used = ++requests;
+            size_t start = sizeof(length) + length;
+            found->second.converter->fswtotex(reinterpret_cast<const uint8_t*>(request.data()) + start,
+                request.size() - start, &converted);
+        }
+        catch (char const* message)
+        {
+            failure = string("Failure: ") + message + "\n";
+        }
+        catch (...)
         {
-            if ((coming[i] & 0xc0) != 0x80)
-                return 0;
-            going[0] <<= 6;
-            going[0] |= (coming[i] & 0x3f);
+            failure = "Failure: Unexpected failure.\n";
         }
-        return 2;
+        string reply(1, failure.empty() ? 0 : 1);
+        if (!failure.empty())
+        {
+            uint32_t size = static_cast<uint32_t>(failure.size());
+            reply.append(reinterpret_cast<const char*>(&size), sizeof(size));
+            reply += failure;
+        }
+        reply += converted.str();
+        sendAll(client, reply.data(), reply.size());
+        close(client);
     }
-    if ((coming[0] & 0xc0) == 0x80)
+    close(listening);
+    if (isSocket(socketName))
+        unlink(socketName.c_str());
+    for (Converters::iterator i = converters.begin(); i != converters.end(); ++i)
     {
-        throw "Malformed utf8 string.";
+        if (i->second.converter)
+            i->second.converter->saveCache();
     }
-    going[0] = coming[0];
-    return 1;
+    return 0;
 }
 
-int utf16leToUtf32(uint8_t* coming, uint32_t* going)
-{
-    // Quick review, after accounting for endianess
-    // 0000--d7ff = pass along
-    // d800--d8ff = a following dc00-dfff tells the low 10 bits
-    // dc00--dfff = better be following d800-d8ff
-    // e000--ffff = pass along
-    going[0] = coming[0] << 0;
-    going[0] |= coming[1] << 8;
-    if (going[0] < 0xd800)
-        return 2;
-    if (going[0] < 0xdc00)
+// Have the server convert this text. False if there is no server to ask.
+bool askServer(const Options& options, const string& socketName, const string& text, string& reply, string& failure)
+{
+    sockaddr_un address = socketAddress(socketName);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return false;
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        return false;
+    }
+    string encoded = encodeOptions(options);
+    uint32_t length = static_cast<uint32_t>(encoded.size());
+    string request(reinterpret_cast<const char*>(&length), sizeof(length));
+    request += encoded;
+    request += text;
+    reply.clear();
+    bool answered = sendAll(fd, request.data(), request.size()) && shutdown(fd, SHUT_WR) == 0 &&
+        receiveAll(fd, reply) && !reply.empty();
+    close(fd);
+    if (!answered)
+        return false;
+    size_t start = 1;
+    failure.clear();
+    if (reply[0] != 0)
+    {
+        uint32_t size = 0;
+        if (reply.size() < 1 + sizeof(size))
+            return false;
+        memcpy(&size, &reply[1], sizeof(size));
+        if (reply.size() - 1 - sizeof(size) < size)
+            return false;
+        failure = reply.substr(1 + sizeof(size), size);
+        start = 1 + sizeof(size) + size;
+    }
+    reply.erase(0, start);
+    return true;
+}
+
+// --client: read the input, have the server convert it, and write what
+// comes back just where we would have written it ourselves. If there is no
+// server, we convert what we read ourselves.
+int runClient(const Options& options, const string& socketName, const vector<string>& fileNames,
+    int argc, char** argv)
+{
+    string text;
+    if (fileNames.empty())
+    {
+        text.assign(istreambuf_iterator<char>(cin), istreambuf_iterator<char>());
+    }
+    else
+    {
+        readFile(fileNames[0], text);
+    }
+    ofstream fout;
+    ostream* out = &cout;
+    if (fileNames.size() == 2)
     {
-        if (coming[3] < 0xdc || coming[3]>0xdf)
-            return 0;
-        going[0] &= 0x3ff;
-        going[0] |= 0x400;
-        going[0] <<= 10;
-        going[0] |= coming[2];
-        going[0] |= (coming[3] & 0x3) << 8;
-        return 2;
+        fout.open(fileNames[1], ios::out | ios::binary);
+        if (!fout)
+            throw "Unable to open the output file.";
+        out = &fout;
     }
-    if (going[0] < 0xe000)
-        throw "Malformed utf16le string";
-    return 2;
+    string reply;
+    string failure;
+    if (askServer(options, socketName, text, reply, failure))
+    {
+        *out << reply;
+        if (!failure.empty())
+        {
+            out->flush();
+            cout << failure;
+            return -1;
+        }
+    }
+    else
+    {
+        Converter converter(options);
+        converter.loadCache();
+        converter.fswtotex(reinterpret_cast<const uint8_t*>(text.data()), text.size(), out);
+        converter.saveCache();
+    }
+    writeTrailer(*out, argc, argv);
+    return 0;
 }
 
-int utf16beToUtf32(uint8_t* coming, uint32_t* going)
+/*
+    With --watch, we keep an eye on a directory and convert each file in it
+    whose name ends in .sw.tex into the same name ending in just .tex,
+    whenever it changes. To start with, we convert any that are newer than
+    what they were converted into. After that inotify tells us when a file
+    has been written and closed, or moved into the directory, which is how
+    most editors save. An editor often saves a file in a few steps, so once
+    something changes we wait until nothing has for a moment, or a second
+    at most, and then convert each file that changed once. The converter, and so its cache,
+    stays with us the whole time.
+*/
+
+const char* const sourceEnding = ".sw.tex";
+const int settleMilliseconds = 100;
+const int settleLimitMilliseconds = 1000;
+
+// A file descriptor that is closed when we leave, however we leave.
+struct Descriptor
 {
-    // Quick review, after accounting for endianess
-    // 0000--d7ff = pass along
-    // d800--d8ff = a following dc00-dfff tells the low 10 bits
-    // dc00--dfff = better be following d800-d8ff
-    going[0] = coming[0] << 8;
-    going[0] |= coming[1] << 0;
-    if (going[0] < 0xd800)
-        return 2;
-    if (going[0] < 0xdc00)
+    int fd = -1;
+
+    ~Descriptor()
     {
-        if (coming[2] < 0xdc || coming[2]>0xdf)
-            return 0;
-        going[0] &= 0x3ff;
-        going[0] |= 0x400;
-        going[0] <<= 10;
-        going[0] |= (coming[2] & 0x3) << 8;
-        going[0] |= coming[3];
-        return 2;
+        if (fd >= 0)
+            close(fd);
     }
-    if (going[0] < 0xe000)
-        throw "Malformed utf16le string";
-    return 2;
-}
+};
 
-int utf32leToUtf32(uint8_t* coming, uint32_t* going)
+bool isSource(const string& name)
 {
-    going[0] = coming[0] << 0;
-    going[0] |= coming[1] << 8;
-    going[0] |= coming[2] << 16;
-    going[0] |= coming[3] << 24;
-    return 4;
+    size_t ending = strlen(sourceEnding);
+    return name.size() > ending && name.compare(name.size() - ending, ending, sourceEnding) == 0;
 }
 
-int utf32beToUtf32(uint8_t* coming, uint32_t* going)
+void convertSource(Converter& converter, const Options& options, const string& directory,
+    const string& name, int argc, char** argv)
 {
-    going[0] = coming[0] << 24;
-    going[0] |= coming[1] << 16;
-    going[0] |= coming[2] << 8;
-    going[0] |= coming[3] << 0;
-    return 4;
+    string inName = directory + "/" + name;
+    string outName = inName.substr(0, inName.size() - strlen(sourceEnding)) + ".tex";
+    try
+    {
+        // Editors often save by writing over the file in place, and doing
+        // that to a file we have mapped would kill us, so it is read in.
+        convertFile(converter, options, inName, outName, argc, argv, true);
+        converter.saveCache();
+        cout << "Converted " << inName << endl;
+    }
+    catch (char const* message)
+    {
+        cout << "Failure: " << inName << ": " << message << endl;
+    }
+    catch (...)
+    {
+        cout << "Failure: " << inName << ": Unexpected failure." << endl;
+    }
 }
 
-// Finally, let's explain and start the program
-
-int usage()
+int watch(const Options& options, const string& directory, int argc, char** argv)
 {
-    cout << "This is fswtotex." << endl;
-    cout << endl;
-    cout << "This program runs in one of three ways." << endl;
-    cout << "If you provide no arguments, we read from standard in and send the results to standard out." << endl;
-    cout << "If you provide one argument, we read from that file and send the results to standard out." << endl;
-    cout << "If you provide two arguments, we read from the first file and send the results to the second file." << endl;
-    cout << endl;
-    cout << "So what do we do?" << endl;
-    cout << endl;
-    cout << "We read LaTeX code with embedded SignWriting words (see http://signwriting.org) and output LaTeX "
-        "code with TiKz drawings of SignWriting symbols." << endl;
-    cout << endl;
-    cout << "There are a few modifications you can take advantage of though:" << endl;
-    cout << "--fsize <string>  By default we assume a string called f@size holds the size which is" << endl;
-    cout << "                  generally a usable value to use in LaTex documents. You can change" << endl;
-    cout << "                  this if (for instance) you want SignWriting text to be a different" << endl;
-    cout << "                  size or you already have some other length being used. Fswtotex does" << endl;
-    cout << "                  add a \\ in front of the string you provide." << endl;
-    cout << "--nomirror        By default we mirror, this turns that off." << endl;
-    cout << "--rotate <number> By default we assume a value of -90. The reason we default to mirrored" << endl;
-    cout << "                  and rotated by -90 degrees pages is because SignWriting is a vertical" << endl;
-    cout << "                  writing system. By rotating the page by -90 degrees we turn horizontal" << endl;
-    cout << "                  lines into vertical columns. But this alone would make for columns of" << endl;
-    cout << "                  text moving from right to left, so by adding a mirror to the text we" << endl;
-    cout << "                  get vertial columns of text moving from left to right. The next most" << endl;
-    cout << "                  likely settings you may want would be --nomirror --rotate 0, as this" << endl;
-    cout << "                  allows for insertion of SignWriting in the midst of English text but" << endl;
-    cout << "                  does require the author to handle things like placing the text into" << endl;
-    cout << "                  a multi-column environment and adding linebreaks after each word." << endl;
-    cout << "--spelling        By default, we don't spell. If this option is added then columns of" << endl;
-    cout << "                  of symbols will appear above the word if it has a time domain prefix." << endl;
+    Descriptor watching;
+    watching.fd = inotify_init1(IN_CLOEXEC);
+    if (watching.fd < 0 || inotify_add_watch(watching.fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+        throw "Unable to watch the directory.";
+    struct sigaction stopping;
+    memset(&stopping, 0, sizeof(stopping));
+    stopping.sa_handler = stopRunning;
+    sigaction(SIGINT, &stopping, 0);
+    sigaction(SIGTERM, &stopping, 0);
+
+    Converter converter(options);
+    converter.loadCache();
+    DIR* listing = opendir(directory.c_str());
+    if (listing == 0)
+        throw "Unable to read the directory.";
+    set<string> changed;
+    for (dirent* entry = readdir(listing); entry != 0; entry = readdir(listing))
+    {
+        string name = entry->d_name;
+        if (!isSource(name))
+            continue;
+        string inName = directory + "/" + name;
+        string outName = inName.substr(0, inName.size() - strlen(sourceEnding)) + ".tex";
+        struct stat in, out;
+        if (stat(inName.c_str(), &in) == 0 && (stat(outName.c_str(), &out) != 0 || out.st_mtime < in.st_mtime))
+            changed.insert(name);
+    }
+    closedir(listing);
+
+    alignas(inotify_event) char events[64 * 1024];
+    pollfd waiting = { watching.fd, POLLIN, 0 };
+    while (running)
+    {
+        for (set<string>::const_iterator i = changed.begin(); i != changed.end(); ++i)
+            convertSource(converter, options, directory, *i, argc, argv);
+        changed.clear();
+        // Wait for something to change, and then for it to settle down, but
+        // not for ever if it never does.
+        int timeout = -1;
+        chrono::steady_clock::time_point deadline;
+        while (running && poll(&waiting, 1, timeout) > 0)
+        {
+            if (timeout < 0)
+                deadline = chrono::steady_clock::now() + chrono::milliseconds(settleLimitMilliseconds);
+            ssize_t size = read(watching.fd, events, sizeof(events));
+            for (ssize_t place = 0; place < size; )
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(events + place);
+                if (event->len > 0 && isSource(event->name))
+                    changed.insert(event->name);
+                place += sizeof(inotify_event) + event->len;
+            }
+            long long left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now()).count();
+            if (left <= 0)
+                break;
+            timeout = left < settleMilliseconds ? static_cast<int>(left) : settleMilliseconds;
+        }
+    }
+    converter.saveCache();
     return 0;
 }
 
-int fswtotex(istream* fileIn, ostream* fileOut);
-
-const string defaultfsize = "f@size";
-string fsize = defaultfsize;
-bool hasat = true;
-bool mirror = true;
-int rotation = -90;
-bool spelling = false;
-
 int main(int argc, char** argv)
 {
     //  We an run in about three different ways.
     //  1)  read from standard in and write to standard out (0 arguments)
     //  2)  read from a file and write to standard out (1 argument)
     //  3)  read from a file and write to a file (2 arguments)
+    //  4)  read from any number of files and write to as many (--batch or --manifest)
+    //  5)  convert whatever is sent to a socket (--serve), or send it there (--client)
+    //  6)  convert files in a directory whenever they change (--watch)
     //  In order to accomplish this, we first process the arguments,
     //  and then set up in istream and ostream, and let it rip.
     //  When processing the arguments we also have to consider the arguments to control
@@ -610,8 +810,15 @@ int main(int argc, char** argv)
     //    mirroring
     //    rotation
 
-    int fileCounts = 0;
-    string fileNames[2];
+    Options options;
+    bool stats = false;
+    bool batched = false;
+    string manifest;
+    string serveSocket;
+    string clientSocket;
+    string watched;
+    size_t threads = thread::hardware_concurrency();
+    vector<string> fileNames;
     int result = -1;
     for (int i = 1; i < argc; i++)
     {
@@ -623,13 +830,11 @@ int main(int argc, char** argv)
                 cout << "--fsize requires a following string" << endl;
                 return result;
             }
-            fsize = argv[i];
-            if (fsize.find("@") == string::npos)
-                hasat = false;
+            options.fsize = argv[i];
         }
         else if (string(argv[i]) == "--nomirror")
         {
-            mirror = false;
+            options.mirror = false;
         }
         else if (string(argv[i]) == "--rotate")
         {
@@ -639,1351 +844,229 @@ int main(int argc, char** argv)
                 cout << "--rotate requires a following number" << endl;
                 return result;
             }
-            rotation = atoi(argv[i]);
+            options.rotation = atoi(argv[i]);
         }
         else if (string(argv[i]) == "--spelling")
         {
-            spelling = true;
+            options.spelling = true;
         }
-        else if (argv[i][0] == '-')
+        else if (string(argv[i]) == "--compact")
         {
-            return usage();
+            options.compact = true;
         }
-        else
+        else if (string(argv[i]) == "--merge")
+        {
+            options.merge = true;
+        }
+        else if (string(argv[i]) == "--ptsize")
         {
-            if (fileCounts >= 2)
+            i++;
+            if (i >= argc || atof(argv[i]) <= 0)
             {
-                cout << "We can only accept two files, and the second one is overwritten." << endl;
+                cout << "--ptsize requires a following positive number" << endl;
                 return result;
             }
-            fileNames[fileCounts++] = argv[i];
+            options.ptsize = atof(argv[i]);
         }
-    }
-    try
-    {
-        if (fileCounts == 0)
+        else if (string(argv[i]) == "--cache")
         {
-            // standard in and standard out
-            result = fswtotex(&cin, &cout);
-            cout << "% This file was generated by:" << endl;
-            cout << "%    ";
-            for (int i = 0; i < argc; i++)
-                cout << argv[i] << " ";
-            cout << endl;
+            i++;
+            if (i >= argc)
+            {
+                cout << "--cache requires a following directory" << endl;
+                return result;
+            }
+            options.cache = argv[i];
         }
-        else if (fileCounts == 1)
+        else if (string(argv[i]) == "--savebox")
         {
-            // file to standard out
-            fstream fin;
-            fin.open(fileNames[0], ios::in);
-            result = fswtotex(&fin, &cout);
-            cout << "% This file was generated by:" << endl;
-            cout << "%    ";
-            for (int i = 0; i < argc; i++)
-                cout << argv[i] << " ";
-            cout << endl;
+            options.savebox = true;
         }
-        else if (fileCounts == 2)
+        else if (string(argv[i]) == "--incremental")
         {
-            // file to file
-            fstream fin, fout;
-            fin.open(fileNames[0], ios::in);
-            fout.open(fileNames[1], ios::out);
-            result = fswtotex(&fin, &fout);
-            fout << "% This file was generated by:" << endl;
-            fout << "%    ";
-            for (int i = 0; i < argc; i++)
-                fout << argv[i] << " ";
-            fout << endl;
+            options.incremental = true;
         }
-    }
-    catch (char const* message)
-    {
-        cout << "Failure: " << message << endl;
-        result = -1;
-    }
-    return result;
-}
-
-/*
-    Now we have our state processing functions.
-    For each set of states we have a separate function that expects a uint32_t
-    (which represents the Unicode character in question). There are three possible
-    results from being in a state and receiving a character.
-    1) Move forward to a new state.
-    2) Notice an error and spit out the currently stored data unchanged.
-    3) Notice that the match is complete and translate it.
-
-    By far the largest section of code will be to move forward to a new state,
-    and each potential move forward will hake a check for errors. Occasionally,
-    an ``error'' state will actually indicate a successful completion and we
-    will do a translation.
-
-    Let's start with our storage and state management followed by declaring our
-    state progression functions.
-
-    One final note, this SignWriting converter is actually too permissive.
-    In this converter you can use unicode for the symbol and ``text'' for
-    the numbers, or the reverse. I believe that you should actually be
-    required to do one or the other, but there it is. If I were ever to make a
-    version that did not let you mix and match FSWA and FSWU, we would have two
-    sets of functions.
-
-    It's may also not be permissive enough in that if you have "AS123M", it may
-    miss that M starts a word. I didn't bother testing for this behavior. I also
-    don't look through a partially accepted string to see if a new one should
-    start so if you say "M500x500S10000500x500S" then this is a failure and the
-    first portion will not be translated.
-
-    Each of these states tells us what is being expected. So, for instance,
-    start_start_start is expecting to see a word start. If it doesn't, then it just
-    sends the character along. But visual_size_secondw is expecting the second digit
-    of the number expressing the width. If it doesn't, then it will need to spit out
-    what it has already stored and then go back to start. This is also why there
-    aren't any functions for "_end", that would mean that it's expecting one
-    character past the last one.
-*/
-
-vector<uint32_t> line;
-
-void start(ostream* fileOut, uint32_t c);
-void punctuation(ostream* fileOut, uint32_t c);
-void prefix(ostream* fileOut, uint32_t c);
-void visual(ostream* fileOut, uint32_t c);
-void start_start(ostream* fileOut, uint32_t c);
-void punctuation_start(ostream* fileOut, uint32_t c);
-void punctuation_symbol(ostream* fileOut, uint32_t c);
-void punctuation_placement(ostream* fileOut, uint32_t c);
-void prefix_symbol(ostream* fileOut, uint32_t c);
-void visual_start(ostream* fileOut, uint32_t c);
-void visual_size(ostream* fileOut, uint32_t c);
-void visual_symbol(ostream* fileOut, uint32_t c);
-void visual_placement(ostream* fileOut, uint32_t c);
-void start_start_start(ostream* fileOut, uint32_t c);
-void punctuation_start_start(ostream* fileOut, uint32_t c);
-void punctuation_symbol_start(ostream* fileOut, uint32_t c);
-void punctuation_symbol_first(ostream* fileOut, uint32_t c);
-void punctuation_symbol_second(ostream* fileOut, uint32_t c);
-void punctuation_symbol_third(ostream* fileOut, uint32_t c);
-void punctuation_symbol_fill(ostream* fileOut, uint32_t c);
-void punctuation_symbol_rotation(ostream* fileOut, uint32_t c);
-void punctuation_placement_firstw(ostream* fileOut, uint32_t c);
-void punctuation_placement_secondw(ostream* fileOut, uint32_t c);
-void punctuation_placement_thirdw(ostream* fileOut, uint32_t c);
-void punctuation_placement_x(ostream* fileOut, uint32_t c);
-void punctuation_placement_firsth(ostream* fileOut, uint32_t c);
-void punctuation_placement_secondh(ostream* fileOut, uint32_t c);
-void punctuation_placement_thirdh(ostream* fileOut, uint32_t c);
-void punctuation_placement_end(ostream* fileOut, uint32_t c);
-void prefix_symbol_start(ostream* fileOut, uint32_t c);
-void prefix_symbol_first(ostream* fileOut, uint32_t c);
-void prefix_symbol_second(ostream* fileOut, uint32_t c);
-void prefix_symbol_third(ostream* fileOut, uint32_t c);
-void prefix_symbol_fill(ostream* fileOut, uint32_t c);
-void prefix_symbol_rotation(ostream* fileOut, uint32_t c);
-void visual_start_start(ostream* fileOut, uint32_t c);
-void visual_size_firstw(ostream* fileOut, uint32_t c);
-void visual_size_secondw(ostream* fileOut, uint32_t c);
-void visual_size_thirdw(ostream* fileOut, uint32_t c);
-void visual_size_x(ostream* fileOut, uint32_t c);
-void visual_size_firsth(ostream* fileOut, uint32_t c);
-void visual_size_secondh(ostream* fileOut, uint32_t c);
-void visual_size_thirdh(ostream* fileOut, uint32_t c);
-void visual_symbol_start(ostream* fileOut, uint32_t c);
-void visual_symbol_first(ostream* fileOut, uint32_t c);
-void visual_symbol_second(ostream* fileOut, uint32_t c);
-void visual_symbol_third(ostream* fileOut, uint32_t c);
-void visual_symbol_fill(ostream* fileOut, uint32_t c);
-void visual_symbol_rotation(ostream* fileOut, uint32_t c);
-void visual_placement_firstw(ostream* fileOut, uint32_t c);
-void visual_placement_secondw(ostream* fileOut, uint32_t c);
-void visual_placement_thirdw(ostream* fileOut, uint32_t c);
-void visual_placement_x(ostream* fileOut, uint32_t c);
-void visual_placement_firsth(ostream* fileOut, uint32_t c);
-void visual_placement_secondh(ostream* fileOut, uint32_t c);
-void visual_placement_thirdh(ostream* fileOut, uint32_t c);
-void visual_placement_end(ostream* fileOut, uint32_t c);
-
-int fswtotex(istream* fileIn, ostream* fileOut)
-{
-    state = substate = subsubstate = s_start;
-    uint32_t c = 0;
-    while (c != 0xffffffff)
-    {
-        c = getChar(fileIn);
-        if (c == 0xffffffff)
-            continue;
-        if (state == s_start)       start(fileOut, c);
-        else if (state == s_prefix)      prefix(fileOut, c);
-        else if (state == s_visual)      visual(fileOut, c);
-        else if (state == s_punctuation) punctuation(fileOut, c);
-        else throw "Unknown state.";
-    }
-    (*fileOut) << endl;
-    (*fileOut) << "% In order for this conversion to work your document needs a few things around "
-        "your SignWriting text." << endl;
-    (*fileOut) << endl;
-    (*fileOut) << "\\documentclass{article}" << endl;
-    (*fileOut) << endl;
-    (*fileOut) << "\\usepackage{fontspec}" << endl;
-    (*fileOut) << "\\usepackage{tikz}" << endl;
-    if ((rotation == -90) || (rotation == 90))
-        (*fileOut) << "\\usepackage[landscape]{geometry}" << endl;
-    if (mirror)
-        (*fileOut) << "\\usepackage[mirror]{crop}" << endl;
-    if (rotation != 0)
-    {
-        (*fileOut) << "\\usepackage{everypage}" << endl;
-        (*fileOut) << "\\AddEverypageHook{\\special{pdf: put @thispage <</Rotate " << rotation << ">>}}" << endl;
-    }
-    (*fileOut) << endl;
-    (*fileOut) << "\\begin{document}" << endl;
-    (*fileOut) << endl;
-    (*fileOut) << "\\newfontfamily\\swfill{SuttonSignWritingFill.ttf}" << endl;
-    (*fileOut) << "\\newfontfamily\\swline{SuttonSignWritingLine.ttf}" << endl;
-    if (fsize != defaultfsize)
-    {
-        (*fileOut) << "\\newlength{\\" << fsize << "}" << endl;
-        (*fileOut) << "\\setlength{\\" << fsize << "}{12pt}" << endl;
-    }
-    (*fileOut) << endl;
-    (*fileOut) << "% SignWriting text goes here" << endl;
-    (*fileOut) << endl;
-    (*fileOut) << "\\end{document}" << endl;
-    return 0;
-}
-
-/*
-    We are going to cover these states breadth first.
-    That is, all the base states, then the two-level states, then ...
-*/
-
-void start(ostream* fileOut, uint32_t c)
-{
-    if (substate == s_start) start_start(fileOut, c);
-    else throw "Unknown substate in start.";
-}
-
-void punctuation(ostream* fileOut, uint32_t c)
-{
-    if (substate == s_start)     punctuation_start(fileOut, c);
-    else if (substate == s_symbol)    punctuation_symbol(fileOut, c);
-    else if (substate == s_placement) punctuation_placement(fileOut, c);
-    else throw "Unknown substate in punctuation.";
-}
-
-void prefix(ostream* fileOut, uint32_t c)
-{
-    if (substate == s_symbol) prefix_symbol(fileOut, c);
-    else throw "Unknown substate in prefix.";
-}
-
-void visual(ostream* fileOut, uint32_t c)
-{
-    if (substate == s_start)     visual_start(fileOut, c);
-    else if (substate == s_size)      visual_size(fileOut, c);
-    else if (substate == s_symbol)    visual_symbol(fileOut, c);
-    else if (substate == s_placement) visual_placement(fileOut, c);
-    else throw "Unknown substate in visual.";
-}
-
-void start_start(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start) start_start_start(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void punctuation_start(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start) punctuation_start_start(fileOut, c);
-    else throw "Unknown subsubstate in punctuation, start.";
-}
-
-void punctuation_symbol(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start)    punctuation_symbol_start(fileOut, c);
-    else if (subsubstate == s_first)    punctuation_symbol_first(fileOut, c);
-    else if (subsubstate == s_second)   punctuation_symbol_second(fileOut, c);
-    else if (subsubstate == s_third)    punctuation_symbol_third(fileOut, c);
-    else if (subsubstate == s_fill)     punctuation_symbol_fill(fileOut, c);
-    else if (subsubstate == s_rotation) punctuation_symbol_rotation(fileOut, c);
-    else throw "Unknown subsubstate in punctuation, symbol.";
-}
-
-void punctuation_placement(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_firstw)  punctuation_placement_firstw(fileOut, c);
-    else if (subsubstate == s_secondw) punctuation_placement_secondw(fileOut, c);
-    else if (subsubstate == s_thirdw)  punctuation_placement_thirdw(fileOut, c);
-    else if (subsubstate == s_x)       punctuation_placement_x(fileOut, c);
-    else if (subsubstate == s_firsth)  punctuation_placement_firsth(fileOut, c);
-    else if (subsubstate == s_secondh) punctuation_placement_secondh(fileOut, c);
-    else if (subsubstate == s_thirdh)  punctuation_placement_thirdh(fileOut, c);
-    else if (subsubstate == s_end)     punctuation_placement_end(fileOut, c);
-    else throw "Unknown subsubstate in punctuation, placement.";
-}
-
-void prefix_symbol(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start)    prefix_symbol_start(fileOut, c);
-    else if (subsubstate == s_first)    prefix_symbol_first(fileOut, c);
-    else if (subsubstate == s_second)   prefix_symbol_second(fileOut, c);
-    else if (subsubstate == s_third)    prefix_symbol_third(fileOut, c);
-    else if (subsubstate == s_fill)     prefix_symbol_fill(fileOut, c);
-    else if (subsubstate == s_rotation) prefix_symbol_rotation(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void visual_start(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start)   visual_start_start(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void visual_size(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_firstw)  visual_size_firstw(fileOut, c);
-    else if (subsubstate == s_secondw) visual_size_secondw(fileOut, c);
-    else if (subsubstate == s_thirdw)  visual_size_thirdw(fileOut, c);
-    else if (subsubstate == s_x)       visual_size_x(fileOut, c);
-    else if (subsubstate == s_firsth)  visual_size_firsth(fileOut, c);
-    else if (subsubstate == s_secondh) visual_size_secondh(fileOut, c);
-    else if (subsubstate == s_thirdh)  visual_size_thirdh(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void visual_symbol(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_start)    visual_symbol_start(fileOut, c);
-    else if (subsubstate == s_first)    visual_symbol_first(fileOut, c);
-    else if (subsubstate == s_second)   visual_symbol_second(fileOut, c);
-    else if (subsubstate == s_third)    visual_symbol_third(fileOut, c);
-    else if (subsubstate == s_fill)     visual_symbol_fill(fileOut, c);
-    else if (subsubstate == s_rotation) visual_symbol_rotation(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void visual_placement(ostream* fileOut, uint32_t c)
-{
-    if (subsubstate == s_firstw)  visual_placement_firstw(fileOut, c);
-    else if (subsubstate == s_secondw) visual_placement_secondw(fileOut, c);
-    else if (subsubstate == s_thirdw)  visual_placement_thirdw(fileOut, c);
-    else if (subsubstate == s_x)       visual_placement_x(fileOut, c);
-    else if (subsubstate == s_firsth)  visual_placement_firsth(fileOut, c);
-    else if (subsubstate == s_secondh) visual_placement_secondh(fileOut, c);
-    else if (subsubstate == s_thirdh)  visual_placement_thirdh(fileOut, c);
-    else if (subsubstate == s_end)     visual_placement_end(fileOut, c);
-    else throw "Unknown subsubstate.";
-}
-
-void start_start_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'A' || c == 0x1d800)
-    {
-        line.push_back(c); state = s_prefix; substate = s_symbol; subsubstate = s_start;
-    }
-    else if (c == 'B' || (c >= 'L' && c <= 'M') || c == 'R' || (c >= 0x1d801 && c <= 0x1d804))
-    {
-        line.push_back(c); state = s_visual; substate = s_size; subsubstate = s_firstw;
-    }
-    else if (c == 'S')
-    {
-        line.push_back(c); state = s_punctuation; substate = s_symbol; subsubstate = s_first;
-    }
-    else
-        sendOut(fileOut, c);
-}
-
-
-void punctuation_start_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'S')
-    {
-        line.push_back(c); substate = s_symbol; subsubstate = s_first;
-    }
-    else if (c >= 0x4f424 && c <= 0x4f428)
-    {
-        line.push_back(c); substate = s_placement; subsubstate = s_first;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'S')
-    {
-        line.push_back(c); substate = s_symbol; subsubstate = s_first;
-    }
-    else if (c >= 0x4f424 && c <= 0x4f428)
-    {
-        line.push_back(c); substate = s_placement; subsubstate = s_first;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_first(ostream* fileOut, uint32_t c)
-{
-    if (c == '3')
-    {
-        line.push_back(c); subsubstate = s_second;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_second(ostream* fileOut, uint32_t c)
-{
-    if (c == '8')
-    {
-        line.push_back(c); subsubstate = s_third;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_third(ostream* fileOut, uint32_t c)
-{
-    if ((c >= '7' && c <= '9') || (c >= 'a' && c <= 'b'))
-    {
-        line.push_back(c); subsubstate = s_fill;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_fill(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '5')
-    {
-        line.push_back(c); subsubstate = s_rotation;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_symbol_rotation(ostream* fileOut, uint32_t c)
-{
-    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-    {
-        line.push_back(c); substate = s_placement; subsubstate = s_firstw;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_firstw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
-    {
-        line.push_back(c); subsubstate = s_secondw;
-    }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
-    {
-        line.push_back(c); subsubstate = s_firsth;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_secondw(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
-    {
-        if (c >= '5' && c <= '9')
+        else if (string(argv[i]) == "--batch")
         {
-            line.push_back(c); subsubstate = s_thirdw;
+            batched = true;
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
+        else if (string(argv[i]) == "--manifest")
         {
-            line.push_back(c); subsubstate = s_thirdw;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else // if(line[line.Length-1]=='7')
-    {
-        if (c >= '0' && c <= '4')
-        {
-            line.push_back(c); subsubstate = s_thirdw;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void punctuation_placement_thirdw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); subsubstate = s_x;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_x(ostream* fileOut, uint32_t c)
-{
-    if (c == 'x')
-    {
-        line.push_back(c); subsubstate = s_firsth;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_firsth(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
-    {
-        line.push_back(c); subsubstate = s_secondh;
-    }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
-    {
-        line.push_back(c); subsubstate = s_end;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_secondh(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
-    {
-        if (c >= '5' && c <= '9')
-        {
-            line.push_back(c); subsubstate = s_thirdh;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
-        {
-            line.push_back(c); subsubstate = s_thirdh;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else // if(line[line.Length-1]=='7')
-    {
-        if (c >= '0' && c <= '4')
-        {
-            line.push_back(c); subsubstate = s_thirdh;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void punctuation_placement_thirdh(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); subsubstate = s_end;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void punctuation_placement_end(ostream* fileOut, uint32_t c)
-{
-    vector<uint32_t> temp;
-    temp.push_back('M');
-    temp.push_back('5');
-    temp.push_back('0');
-    temp.push_back('0');
-    temp.push_back('x');
-    temp.push_back('5');
-    temp.push_back('0');
-    temp.push_back('0');
-    for (size_t i = 0; i < line.size(); i++)
-        temp.push_back(line[i]);
-    line.clear();
-    for (size_t i = 0; i < temp.size(); i++)
-        line.push_back(temp[i]);
-    visual_placement_end(fileOut, c);
-}
-
-void prefix_symbol_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'S')
-    {
-        line.push_back(c); subsubstate = s_first;
-    }
-    else if (c >= 0x40001 && c <= 0x4f428)
-    {
-        line.push_back(c); state = s_visual; substate = s_start; subsubstate = s_start;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void prefix_symbol_first(ostream* fileOut, uint32_t c)
-{
-    if (c >= '1' && c <= '3')
-    {
-        line.push_back(c); subsubstate = s_second;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void prefix_symbol_second(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] >= '0' && line[line.size() - 1] <= '2')
-    {
-        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-        {
-            line.push_back(c); subsubstate = s_third;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else
-    {
-        if (c >= '0' && c <= '8')
-        {
-            line.push_back(c); subsubstate = s_third;
-        }
-        else if (c == 'f')
-        {
-            line.push_back(c); subsubstate = s_third;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void prefix_symbol_third(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 2] >= '0' && line[line.size() - 2] <= '2')
-    {
-        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-        {
-            line.push_back(c); subsubstate = s_fill;
+            i++;
+            if (i >= argc)
+            {
+                cout << "--manifest requires a following file" << endl;
+                return result;
+            }
+            batched = true;
+            manifest = argv[i];
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else
-    {
-        if (line[line.size() - 1] >= '0' && line[line.size() - 1] <= '7')
+        else if (string(argv[i]) == "--jobs")
         {
-            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
+            i++;
+            if (i >= argc || atoi(argv[i]) <= 0)
             {
-                line.push_back(c); subsubstate = s_fill;
+                cout << "--jobs requires a following positive number" << endl;
+                return result;
             }
-            else
-                sendOut(fileOut, line, c);
+            threads = atoi(argv[i]);
         }
-        else if (line[line.size() - 1] == '8')
+        else if (string(argv[i]) == "--serve" || string(argv[i]) == "--client")
         {
-            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'b'))
+            string option = argv[i];
+            i++;
+            if (i >= argc)
             {
-                line.push_back(c); subsubstate = s_fill;
+                cout << option << " requires a following socket" << endl;
+                return result;
             }
-            else
-                sendOut(fileOut, line, c);
+            (option == "--serve" ? serveSocket : clientSocket) = argv[i];
         }
-        else // =='f'
+        else if (string(argv[i]) == "--watch")
         {
-            if (c == 'f')
+            i++;
+            if (i >= argc)
             {
-                line.push_back(c); subsubstate = s_fill;
+                cout << "--watch requires a following directory" << endl;
+                return result;
             }
-            else
-                sendOut(fileOut, line, c);
+            watched = argv[i];
         }
-    }
-}
-
-void prefix_symbol_fill(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '5')
-    {
-        line.push_back(c); subsubstate = s_rotation;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void prefix_symbol_rotation(ostream* fileOut, uint32_t c)
-{
-    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-    {
-        line.push_back(c); state = s_visual; substate = subsubstate = s_start;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_start_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'B' || (c >= 'L' && c <= 'M') || c == 'R' || (c >= 0x1d801 && c <= 0x1d804))
-    {
-        line.push_back(c); substate = s_size; subsubstate = s_firstw;
-    }
-    else if (c == 'S')
-    {
-        line.push_back(c); state = s_prefix; substate = s_symbol; subsubstate = s_first;
-    }
-    else if (c >= 0x40001 && c <= 0x4f428)
-    {
-        line.push_back(c); state = s_visual; substate = s_start; subsubstate = s_start;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_size_firstw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
-    {
-        line.push_back(c); subsubstate = s_secondw;
-    }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
-    {
-        line.push_back(c); subsubstate = s_firsth;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_size_secondw(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
-    {
-        if (c >= '5' && c <= '9')
+        else if (string(argv[i]) == "--pipeline")
         {
-            line.push_back(c); subsubstate = s_thirdw;
+            options.pipeline = true;
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
+        else if (string(argv[i]) == "--stats")
         {
-            line.push_back(c); subsubstate = s_thirdw;
+            stats = true;
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else // if(line[line.size()-1]=='7')
-    {
-        if (c >= '0' && c <= '4')
+        else if (argv[i][0] == '-')
         {
-            line.push_back(c); subsubstate = s_thirdw;
+            return usage();
         }
         else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void visual_size_thirdw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); subsubstate = s_x;
+        {
+            fileNames.push_back(argv[i]);
+        }
     }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_size_x(ostream* fileOut, uint32_t c)
-{
-    if (c == 'x')
+    size_t fileCounts = fileNames.size();
+    if (fileCounts > 2 && !batched)
     {
-        line.push_back(c); subsubstate = s_firsth;
+        cout << "We can only accept two files, and the second one is overwritten." << endl;
+        return result;
     }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_size_firsth(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
+    if (options.incremental && ((fileCounts != 2 && !batched && watched.empty()) || options.savebox))
     {
-        line.push_back(c); subsubstate = s_secondh;
+        cout << "--incremental needs an output file, and can't be used with --savebox" << endl;
+        return result;
     }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
+    if (!serveSocket.empty())
     {
-        line.push_back(c); substate = s_symbol; subsubstate = s_start;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_size_secondh(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
-    {
-        if (c >= '5' && c <= '9')
+        try
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            return serve(options, serveSocket);
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
+        catch (char const* message)
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            cout << "Failure: " << message << endl;
+            return result;
         }
-        else
-            sendOut(fileOut, line, c);
     }
-    else // if(line[line.size()-1]=='7')
+    if (!watched.empty())
     {
-        if (c >= '0' && c <= '4')
+        try
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            return watch(options, watched, argc, argv);
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void visual_size_thirdh(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); substate = s_symbol; subsubstate = s_start;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_symbol_start(ostream* fileOut, uint32_t c)
-{
-    if (c == 'S')
-    {
-        line.push_back(c); subsubstate = s_first;
-    }
-    else if (c >= 0x40001 && c <= 0x4f428)
-    {
-        line.push_back(c); state = s_visual; substate = s_placement; subsubstate = s_first;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_symbol_first(ostream* fileOut, uint32_t c)
-{
-    if (c >= '1' && c <= '3')
-    {
-        line.push_back(c); subsubstate = s_second;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_symbol_second(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] >= '0' && line[line.size() - 1] <= '2')
-    {
-        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
+        catch (char const* message)
         {
-            line.push_back(c); subsubstate = s_third;
+            cout << "Failure: " << message << endl;
+            return result;
         }
-        else
-            sendOut(fileOut, line, c);
     }
-    else
+    if (!clientSocket.empty() && !batched && !options.incremental)
     {
-        if (c >= '0' && c <= '8')
+        try
         {
-            line.push_back(c); subsubstate = s_third;
+            return runClient(options, clientSocket, fileNames, argc, argv);
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void visual_symbol_third(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 2] >= '0' && line[line.size() - 2] <= '2')
-    {
-        if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
+        catch (char const* message)
         {
-            line.push_back(c); subsubstate = s_fill;
+            cout << "Failure: " << message << endl;
+            return result;
         }
-        else
-            sendOut(fileOut, line, c);
     }
-    else
+    if (batched)
     {
-        if (line[line.size() - 1] >= '0' && line[line.size() - 1] <= '7')
+        Batch batch;
+        batch.options = options;
+        batch.options.threads = 1;
+        batch.argc = argc;
+        batch.argv = argv;
+        for (size_t i = 0; i < fileCounts; i++)
         {
-            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
+            if (!addJob(batch, fileNames[i]))
             {
-                line.push_back(c); subsubstate = s_fill;
+                cout << "--batch takes pairs of files written input:output, not " << fileNames[i] << endl;
+                return result;
             }
-            else
-                sendOut(fileOut, line, c);
         }
-        else
+        if (!manifest.empty())
         {
-            if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'b'))
+            ifstream fin(manifest);
+            if (!fin)
             {
-                line.push_back(c); subsubstate = s_fill;
+                cout << "Unable to open the manifest " << manifest << endl;
+                return result;
+            }
+            string pair;
+            while (getline(fin, pair))
+            {
+                if (!pair.empty() && !addJob(batch, pair))
+                {
+                    cout << "The manifest should hold pairs of files written input:output, not " << pair << endl;
+                    return result;
+                }
             }
-            else
-                sendOut(fileOut, line, c);
-        }
-    }
-}
-
-void visual_symbol_fill(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '5')
-    {
-        line.push_back(c); subsubstate = s_rotation;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_symbol_rotation(ostream* fileOut, uint32_t c)
-{
-    if ((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))
-    {
-        line.push_back(c); substate = s_placement; subsubstate = s_firstw;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_firstw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
-    {
-        line.push_back(c); subsubstate = s_secondw;
-    }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
-    {
-        line.push_back(c); subsubstate = s_firsth;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_secondw(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
-    {
-        if (c >= '5' && c <= '9')
-        {
-            line.push_back(c); subsubstate = s_thirdw;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
-        {
-            line.push_back(c); subsubstate = s_thirdw;
-        }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else // if(line[line.size()-1]=='7')
-    {
-        if (c >= '0' && c <= '4')
-        {
-            line.push_back(c); subsubstate = s_thirdw;
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void visual_placement_thirdw(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); subsubstate = s_x;
+        return runBatch(batch, threads > 0 ? threads : 1, stats);
     }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_x(ostream* fileOut, uint32_t c)
-{
-    if (c == 'x')
-    {
-        line.push_back(c); subsubstate = s_firsth;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_firsth(ostream* fileOut, uint32_t c)
-{
-    if (c >= '2' && c <= '7')
-    {
-        line.push_back(c); subsubstate = s_secondh;
-    }
-    else if (c >= 0x1d80c && c <= 0x1d9ff)
-    {
-        line.push_back(c); subsubstate = s_end;
-    }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_secondh(ostream* fileOut, uint32_t c)
-{
-    if (line[line.size() - 1] == '2')
+    options.threads = threads > 0 ? threads : 1;
+    Converter converter(options);
+    converter.loadCache();
+    size_t allocated = allocations;
+    try
     {
-        if (c >= '5' && c <= '9')
+        if (fileCounts == 0)
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            // standard in and standard out
+            result = converter.fswtotex(&cin, &cout);
+            writeTrailer(cout, argc, argv);
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else if (line[line.size() - 1] >= '3' && line[line.size() - 1] <= '6')
-    {
-        if (c >= '0' && c <= '9')
+        else if (fileCounts == 1)
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            // file to standard out
+            result = converter.fswtotex(fileNames[0], &cout);
+            writeTrailer(cout, argc, argv);
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-    else // if(line[line.size()-1]=='7')
-    {
-        if (c >= '0' && c <= '4')
+        else if (fileCounts == 2)
         {
-            line.push_back(c); subsubstate = s_thirdh;
+            // file to file
+            convertFile(converter, options, fileNames[0], fileNames[1], argc, argv);
+            result = 0;
         }
-        else
-            sendOut(fileOut, line, c);
-    }
-}
-
-void visual_placement_thirdh(ostream* fileOut, uint32_t c)
-{
-    if (c >= '0' && c <= '9')
-    {
-        line.push_back(c); subsubstate = s_end;
+        converter.saveCache();
     }
-    else
-        sendOut(fileOut, line, c);
-}
-
-void visual_placement_end(ostream* fileOut, uint32_t c)
-{
-    vector< vector< uint32_t > > sorting;
-    if (c == 'S')
+    catch (char const* message)
     {
-        line.push_back(c); substate = s_symbol; subsubstate = s_first;
+        cout << "Failure: " << message << endl;
+        result = -1;
     }
-    else if (c >= 0x40001 && c <= 0x4f428)
+    if (stats)
     {
-        line.push_back(c); state = s_visual; substate = s_placement; subsubstate = s_first;
-    }
-    else
-    {
-        state = substate = subsubstate = s_start;
-        unsigned int place = 0;
-        char lane = 'B';
-        if (line[place] == 'A' || line[place] == 0x1d800)
-        {
-            place++;
-            while (line[place] == 'S' || (line[place] >= 0x40001 && line[place] <= 0x4f428))
-            {
-                int s = 0;
-                if (line[place] == 'S')
-                {
-                    place++;
-                    s = (line[place] - '0') * 256;
-                    if (line[place + 1] >= '0' && line[place + 1] <= '9')
-                        s += (line[place + 1] - '0') * 16;
-                    else // if(line[place+1]>='a' && line[place+1]<='f')
-                        s += (line[place + 1] - 'a' + 10) * 16;
-                    if (line[place + 2] >= '0' && line[place + 2] <= '9')
-                        s += (line[place + 2] - '0') * 1;
-                    else // if(line[place+2]>='a' && line[place+2]<='f')
-                        s += (line[place + 2] - 'a' + 10) * 1;
-                    place += 3;
-                    s -= 0x100;
-                    s *= (6 * 16);
-                    s += (line[place] - '0') * 16;
-                    place++;
-                    if (line[place] >= '0' && line[place] <= '9')
-                        s += (line[place] - '0');
-                    else // if(line[place+1]>='a' && line[place+1]<='f')
-                        s += (line[place] - 'a' + 10);
-                    place++;
-                }
-                else // if(line[place]>=0x40001 && line[place]<=0x4f428)
-                {
-                    s = line[place] - 0x40001;
-                    place++;
-                }
-                if (s == (0x387 - 0x100) * (6 * 16))
-                {
-                    sorting.resize(sorting.size() + 1);
-                }
-                else if (s == (0x388 - 0x100) * (6 * 16))
-                {
-                    sorting.resize(sorting.size() + 2);
-                }
-                else
-                {
-                    if (sorting.size() == 0)
-                        sorting.resize(sorting.size() + 1);
-                    sorting[sorting.size() - 1].resize(sorting[sorting.size() - 1].size() + 1);
-                    //for(int i=sorting[sorting.size()-1].size()-1;i>0;i--)
-                    //    sorting[sorting.size()-1][i]=sorting[sorting.size()-1][i-1];
-                    //sorting[sorting.size()-1][0] = s;
-                    sorting[sorting.size() - 1][sorting[sorting.size() - 1].size() - 1] = s;
-                }
-            }
-        }
-        if (line[place] == 'B' || line[place] == 0x1d801)
-            lane = 'B';
-        if (line[place] == 'L' || line[place] == 0x1d802)
-            lane = 'L';
-        if (line[place] == 'M' || line[place] == 0x1d803)
-            lane = 'M';
-        if (line[place] == 'R' || line[place] == 0x1d804)
-            lane = 'R';
-        place++;
-        // We currently ignore the height and width, so we just skip over them.
-        if (line[place] > '2' && line[place] <= '7')
-        {
-            place += 3;
-            // and skip the x
-            place++;
-        }
-        else
-        {
-            place++;
-        }
-        if (line[place] > '2' && line[place] <= '7')
-        {
-            place += 3;
-        }
-        else
-        {
-            place++;
-        }
-        (*fileOut) << "{";
-        if (hasat)
-            (*fileOut) << "\\makeatletter";
-        (*fileOut) << "\\begin{tikzpicture}";
-        if ((rotation != 0) || (mirror == true))
-            (*fileOut) << "[";
-        if (rotation != 0)
-            (*fileOut) << "rotate=" << rotation;
-        if ((rotation != 0) && (mirror == true))
-            (*fileOut) << ",";
-        if (mirror == true)
-            (*fileOut) << "yscale=-1";
-        if ((rotation != 0) || (mirror == true))
-            (*fileOut) << "]";
-        // The idea was, initially, to place a thin rectangle behind each word from 0--1000.
-        // Unfortunately, this made it so that I could reasonably fit about two columns of
-        // \normalsize text to a page. We are now only extend 100 each direction to allow for about
-        // five columns of \normalsize text. This also decided our lane shift amount later on.
-
-        // Yes, I know the number 100 doesn't appear. That's because I found through experimentation
-        // that a character anchored at (0,0) along with a rectangle around (0,0) does not place a
-        // rectangle around the expected corner.
-        if (lane != 'B')
-            (*fileOut) << "\\draw[white](\\" << fsize << "/30*-90 pt,\\" << fsize << "/30*-12 pt)rectangle(\\" << fsize << "/30*110 pt,\\" << fsize << "/30*-10 pt);";
-        if (spelling)
-        {
-            int maxsize = 0;
-            for (size_t x = 0; x < sorting.size(); x++)
-            {
-                if (static_cast<int>(sorting[x].size()) > maxsize)
-                    maxsize = sorting[x].size();
-            }
-            int leftofword = 0;
-            int lastplace = place;
-            while (place < line.size())
-            {
-                if (line[place] == 'S')
-                {
-                    place += 6;
-                }
-                else // if(line[place]>=0x40001 && line[place]<=0x4f428)
-                {
-                    place++;
-                }
-                int sx;
-                if (line[place] > '2' && line[place] <= '7')
-                {
-                    sx = (line[place] - '0') * 100 + (line[place + 1] - '0') * 10 + (line[place + 2] - '0');
-                    place += 3;
-                }
-                else
-                {
-                    sx = line[place] - 0x1d80c + 250;
-                    place++;
-                }
-                sx -= 500;
-                if (sx < leftofword)
-                {
-                    leftofword = sx;
-                }
-            }
-            place = lastplace;
-            for (int x = 0; x < static_cast<int>(sorting.size()); x++)
-            {
-                for (int y = 0; y < static_cast<int>(sorting[x].size()); y++)
-                {
-                    // zitzelsberger
-                    (*fileOut) << "\\begin{scope}[xshift=" << (x * 12 - 7 * static_cast<int>(sorting.size() - 1) - (1 * static_cast<int>(sorting.size() % 2)) + leftofword - 15) << "pt, yshift=" << ((maxsize / 2 - y - 2) * 12) << "pt]";
-                    (*fileOut) << "\\draw(0,0) rectangle (12pt,12pt);";
-                    (*fileOut) << "\\draw(0,13pt) node [";
-                    if (mirror == true)
-                        (*fileOut) << "xscale=-1";
-                    if ((mirror == true) && (rotation != 0))
-                        (*fileOut) << ",";
-                    if (rotation != 0)
-                        (*fileOut) << "rotate=" << rotation;
-                    if ((rotation != 0) || (mirror == true))
-                        (*fileOut) << ",";
-                    (*fileOut) << "anchor=north west] {\\swline";
-                    (*fileOut) << "\\fontsize{6pt}{6pt}\\selectfont";
-                    (*fileOut) << "\\char";
-                    (*fileOut) << (0xf0001 + sorting[x][y]);
-                    (*fileOut) << "};";
-                    (*fileOut) << "\\end{scope}";
-                }
-            }
-        }
-        while (place < line.size())
-        {
-            int s;
-            if (line[place] == 'S')
-            {
-                place++;
-                s = (line[place] - '0') * 256;
-                if (line[place + 1] >= '0' && line[place + 1] <= '9')
-                    s += (line[place + 1] - '0') * 16;
-                else // if(line[place+1]>='a' && line[place+1]<='f')
-                    s += (line[place + 1] - 'a' + 10) * 16;
-                if (line[place + 2] >= '0' && line[place + 2] <= '9')
-                    s += (line[place + 2] - '0') * 1;
-                else // if(line[place+2]>='a' && line[place+2]<='f')
-                    s += (line[place + 2] - 'a' + 10) * 1;
-                place += 3;
-                s -= 0x100;
-                s *= (6 * 16);
-                s += (line[place] - '0') * 16;
-                place++;
-                if (line[place] >= '0' && line[place] <= '9')
-                    s += (line[place] - '0');
-                else // if(line[place+1]>='a' && line[place+1]<='f')
-                    s += (line[place] - 'a' + 10);
-                place++;
-            }
-            else // if(line[place]>=0x40001 && line[place]<=0x4f428)
-            {
-                s = line[place] - 0x40001;
-                place++;
-            }
-            int sx;
-            if (line[place] > '2' && line[place] <= '7')
-            {
-                sx = (line[place] - '0') * 100 + (line[place + 1] - '0') * 10 + (line[place + 2] - '0');
-                place += 3;
-                // and skip the x
-                place++;
-            }
-            else
-            {
-                sx = line[place] - 0x1d80c + 250;
-                place++;
-            }
-            int sy;
-            if (line[place] > '2' && line[place] <= '7')
-            {
-                sy = (line[place] - '0') * 100 + (line[place + 1] - '0') * 10 + (line[place + 2] - '0');
-                place += 3;
-            }
-            else
-            {
-                sy = line[place] - 0x1d80c + 250;
-                place++;
-            }
-            /*
-            At this point, assuming well formed F/USW strings, we will
-            Have a symbol centered around (500,500).
-            For 'B' (meaning horizontal SW) we center it around (0,0).
-            For 'L' we shift it left 250.
-            For 'M' it is correct.
-            For 'R' we shift it right 250.
-            */
-            if (lane == 'B')
-                sx -= 500;
-            if (lane == 'L')
-                sx -= 550;
-            if (lane == 'M')
-                sx -= 500;
-            if (lane == 'R')
-                sx -= 450;
-            sy -= 500;
-            // Now we know where, but for SignWriting the white space can be important too.
-            (*fileOut) << "\\draw(\\" << fsize << "/30*";
-            (*fileOut) << sx;
-            (*fileOut) << " pt,\\" << fsize << "/30*";
-            (*fileOut) << (-sy);
-            (*fileOut) << " pt) node [";
-            if (mirror == true)
-                (*fileOut) << "xscale=-1";
-            if ((mirror == true) && (rotation != 0))
-                (*fileOut) << ",";
-            if (rotation != 0)
-                (*fileOut) << "rotate=" << rotation;
-            if ((rotation != 0) || (mirror == true))
-                (*fileOut) << ",";
-            (*fileOut) << "color=white,anchor=north west] {\\swfill";
-            if (fsize != defaultfsize)
-                (*fileOut) << "\\fontsize{\\" << fsize << "}{\\" << fsize << "}\\selectfont";
-            (*fileOut) << "\\char";
-            (*fileOut) << (0x100001 + s);
-            (*fileOut) << "};";
-            (*fileOut) << "\\draw(\\" << fsize << "/30*";
-            (*fileOut) << sx;
-            (*fileOut) << " pt,\\" << fsize << "/30*";
-            (*fileOut) << (-sy);
-            (*fileOut) << " pt) node [";
-            if (mirror == true)
-                (*fileOut) << "xscale=-1";
-            if ((mirror == true) && (rotation != 0))
-                (*fileOut) << ",";
-            if (rotation != 0)
-                (*fileOut) << "rotate=" << rotation;
-            if ((rotation != 0) || (mirror == true))
-                (*fileOut) << ",";
-            (*fileOut) << "anchor=north west] {\\swline";
-            if (fsize != defaultfsize)
-                (*fileOut) << "\\fontsize{\\" << fsize << "}{\\" << fsize << "}\\selectfont";
-            (*fileOut) << "\\char";
-            (*fileOut) << (0xf0001 + s);
-            (*fileOut) << "};";
-        }
-        (*fileOut) << "\\end{tikzpicture}";
-        (*fileOut) << "}";
-        line.clear();
-        (*fileOut) << static_cast<char>(c);
-        state = substate = subsubstate = s_start;
+        const Counts& counts = converter.counts();
+        cerr << "Converted " << counts.words << " words with " << (allocations - allocated) << " allocations." << endl;
+        cerr << "Word cache: " << counts.hits << " hits, " << counts.misses << " misses." << endl;
     }
+    return result;
 }
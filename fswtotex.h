@@ -0,0 +1,125 @@
+#ifndef FSWTOTEX_H
+#define FSWTOTEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+    This is libfswtotex, which turns text with SignWriting in it into text
+    with TikZ drawings of it. fswtotex itself is just this with a command
+    line around it, and any other program can link it in the same way.
+
+    Make a Converter with the Options you want. A whole file or stream can
+    be converted in one call to fswtotex. Otherwise, call begin, then feed
+    the text to it in pieces as it arrives, and then finish; each piece is
+    converted where it is, not copied first. Anything that wants to know
+    about the signs themselves can have onSign tell it about each one.
+
+    Bad input (a malformed utf8 or utf16 string, say), or an input file
+    that can't be opened, is reported by throwing a const char* saying what
+    went wrong, from whichever call came across it. Whatever was converted
+    before it has been written out by then. A failure to write is left in
+    the ostream's state, as usual. The fswtotex calls always return 0, so
+    checking what they return tells you nothing.
+
+    Everything here is in the fswtotex namespace, and everything else the
+    library uses is kept to libfswtotex.cpp.
+*/
+
+namespace fswtotex
+{
+
+struct Options
+{
+    std::string fsize = "f@size";
+    bool mirror = true;
+    int rotation = -90;
+    bool spelling = false;
+    bool compact = false;
+    bool merge = false;
+    double ptsize = 0;
+    std::string cache;
+    bool savebox = false;
+    bool incremental = false;
+    size_t threads = 1;
+    bool pipeline = false;
+};
+
+// A word as the state machine takes it apart. Symbols are numbered from 0
+// for S10000 up, which is also how far into the fonts their glyphs are.
+struct Placed
+{
+    int symbol;
+    int x;
+    int y;
+};
+
+struct Sign
+{
+    char lane;
+    int width;
+    int height;
+    std::vector<int> prefix;
+    std::vector<Placed> symbols;
+};
+
+// What a conversion did, for --stats.
+struct Counts
+{
+    size_t words = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+};
+
+// Called with each sign as it is read, and the text it was read from.
+typedef void (*SignHandler)(const Sign& sign, const std::string& text, void* context);
+
+class Conversion;
+
+class Converter
+{
+public:
+    Converter(const Options& options);
+    ~Converter();
+
+    // Converting text as it comes: begin, feed it as much as there is, a
+    // piece at a time, and finish. With no ostream, nothing is written,
+    // and the signs aren't even translated, which is fine if all you want
+    // is the signs. Options::savebox and Options::incremental need the
+    // whole input at once, so these ignore them.
+    void begin(std::ostream* out);
+    void feed(const uint8_t* bytes, size_t size);
+    void finish();
+    void onSign(SignHandler handler, void* context);
+
+    int fswtotex(std::istream* fileIn, std::ostream* out);
+    int fswtotex(const uint8_t* bytes, size_t size, std::ostream* out);
+    int fswtotex(const std::string& fileName, std::ostream* out);
+    const Counts& counts() const;
+
+    // With Options::cache, read the cache in before converting and save
+    // what was added to it afterwards. With Options::incremental, read and
+    // save the index kept beside the output file.
+    void loadCache();
+    void saveCache();
+    void loadIndex(const std::string& outName);
+    void saveIndex(const std::string& outName);
+
+    // Only for fswbench, which times each end of a conversion on its own:
+    // decoding text that isn't utf8, without looking for signs in it (it
+    // returns how many characters there were), and writing a sign that has
+    // already been read, after begin. Nothing else needs these.
+    size_t benchDecode(const uint8_t* bytes, size_t size);
+    void benchWrite(const Sign& sign);
+
+private:
+    std::unique_ptr<Conversion> conversion;
+};
+
+}
+
+#endif
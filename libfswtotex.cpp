@@ -0,0 +1,2971 @@
+#include <atomic>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <condition_variable>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fswtotex.h"
+
+using namespace std;
+
+namespace fswtotex
+{
+
+// Only Conversion and Converter are seen outside this file; everything
+// else is in an anonymous namespace.
+
+namespace
+{
+
+// The encodings we can read.
+enum theTextFormat
+{
+    unknown, utf8, utf16le, utf16be, utf32le, utf32be
+};
+
+const size_t blockSize = 64 * 1024;
+
+/*
+    Everything one conversion needs to remember lives in a Conversion, which
+    is what a Converter really is: the options it was asked to use, which
+    format the input turned out to be, where we are in the state machine,
+    and the part of a word we have accepted so far. Nothing is shared between
+    converters, so a process can run as many conversions side by side as it
+    likes, one per converter.
+*/
+
+struct WordTable;
+const WordTable& wordTable();
+
+const size_t writeSize = 256 * 1024;
+
+/*
+    With --pipeline, reading, converting and writing each get a thread, and
+    hand blocks to each other through rings. A ring has one thread putting
+    blocks in and one taking them out, so all it needs is a count of each
+    that only its own side changes. A side with nothing to do sleeps until
+    the other moves, or until the ring is stopped, and the other side only
+    takes the lock to wake it when there is someone asleep.
+*/
+
+struct Block
+{
+    vector<char> bytes;
+    size_t size = 0;
+    bool last = false;
+};
+
+// How many blocks each ring has, and how much room is left at the front of
+// an input block for the end of the one before it.
+const size_t ringBlocks = 8;
+const size_t blockHeadroom = 16;
+
+class Ring
+{
+public:
+    Ring(size_t blockBytes);
+
+    Block* fill();
+    void filled();
+    Block* drain();
+    void drained();
+    void stop();
+
+private:
+    vector<Block> blocks;
+    atomic<size_t> filling;
+    atomic<size_t> draining;
+    atomic<bool> stopped;
+    atomic<int> sleepers;
+    mutex sleeping;
+    condition_variable moved;
+
+    void sleep(const atomic<size_t>& count, size_t until);
+    void wake();
+};
+
+class Writer
+{
+public:
+    Writer();
+
+    void begin(ostream* to);
+    void begin(string* to);
+    void begin(Ring* to);
+    void end();
+    void write(const char* text, size_t size);
+    void put(char c);
+    void utf8(uint32_t c);
+    void flush();
+    size_t written() const;
+    bool discarding() const;
+    bool copySince(size_t mark, string& to) const;
+
+    Writer& operator<<(const char* text);
+    Writer& operator<<(const string& text);
+    Writer& operator<<(int n);
+    Writer& operator<<(double points);
+
+private:
+    ostream* out;
+    string* into;
+    Ring* ring;
+    vector<char> buffer;
+    size_t used;
+    size_t flushed;
+};
+
+/*
+    Most of what we write for a word depends only on the options, not on the
+    word: how the picture is rotated and mirrored, which length the sizes
+    are taken from, and the node options given to every symbol. Those pieces
+    are put together once, when the converter is made, and each symbol then
+    only has its numbers written in between them.
+*/
+
+struct Snippets
+{
+    Snippets(const Options& options);
+
+    string wordStart;   // {\begin{tikzpicture}[...], or \swword{ when compact
+    string wordEnd;
+    string laneBox;     // the white rectangle behind a word that isn't horizontal
+    string at;          // \draw(\f@size/30*, then x
+    string comma;       //  pt,\f@size/30*, then y
+    string fillNode;    //  pt) node [...] {\swfill...\char, then the fill glyph
+    string lineNode;    // the same for the line glyph, or with --merge, what
+                        // comes between the fill glyph and the line glyph
+    string spellNode;   // the box and node of one spelled symbol, up to \char
+    string definitions; // the macros that --compact output is written with
+};
+
+// How many different words we remember the translation of, and how many we
+// remember having seen once.
+const size_t cacheLimit = 64 * 1024;
+const size_t seenSize = 64 * 1024;
+
+// With --savebox, how often a sign comes up in the document and which box,
+// if any, it has been saved in. See finishWord.
+struct SavedBox
+{
+    size_t uses = 0;
+    size_t name = 0;
+};
+
+// LaTeX (with e-TeX) has 32768 box registers, and the document may want
+// some of them for itself.
+const size_t boxLimit = 30000;
+
+// With --incremental, a stretch of whole lines of the input and where what
+// it turned into is in the output. See convertChunks.
+struct Chunk
+{
+    uint64_t hash;
+    uint64_t size;
+    uint64_t place;
+    uint64_t length;
+};
+
+// A chunk ends after a line whose hash has these bits clear, so about one
+// line in 16, or once it is this big.
+const uint64_t chunkMask = 15;
+const size_t chunkLimit = 64 * 1024;
+
+// With more than one thread, one part of a big file, converted on its own.
+// See convertPieces.
+struct Piece
+{
+    const uint8_t* bytes = 0;
+    size_t size = 0;
+    string text;
+    Counts counted;
+    const char* failure = 0;
+    // With --cache, the words it translated, to be saved with the rest.
+    unordered_map<string, string> cache;
+};
+
+// Each thread should have at least this much of the file to work on.
+const size_t pieceMinimum = 1024 * 1024;
+
+// The most room set aside for the output of a piece before it is converted.
+const size_t pieceReserve = 4 * 1024 * 1024;
+
+// A whole file mapped into memory to be read.
+struct MappedFile
+{
+    const char* bytes = 0;
+    size_t size = 0;
+
+    ~MappedFile();
+    bool open(const string& fileName);
+    void close();
+};
+
+// A cache file on disk, mapped into memory. See loadCache.
+struct CacheSlot
+{
+    uint64_t hash;
+    uint64_t place;
+    uint32_t keyLength;
+    uint32_t textLength;
+    uint64_t checksum;
+};
+
+struct CacheFile
+{
+    void* mapped = 0;
+    size_t size = 0;
+    const CacheSlot* slots = 0;
+    uint64_t slotCount = 0;
+    // For each slot, whether its key and text have been checked yet, and
+    // how that went. Pieces on other threads look words up here too.
+    unique_ptr<atomic<uint8_t>[]> checked;
+
+    ~CacheFile();
+    bool open(const string& fileName, const string& header);
+    void close();
+    bool sound(uint64_t i) const;
+    const CacheSlot* find(const string& key) const;
+    const char* text(const CacheSlot* slot) const;
+};
+
+}
+
+class Conversion
+{
+public:
+    Conversion(const Options& options);
+
+    void begin(ostream* out);
+    void feed(const uint8_t* bytes, size_t size);
+    void finish();
+    void onSign(SignHandler handler, void* context);
+
+    int fswtotex(istream* fileIn, ostream* out);
+    int fswtotex(const uint8_t* bytes, size_t size, ostream* out);
+    int fswtotex(const string& fileName, ostream* out);
+    int fswtotexPipelined(istream* fileIn, ostream* out);
+    const Counts& counts() const;
+    void loadCache();
+    void saveCache();
+    void loadIndex(const string& outName);
+    void saveIndex(const string& outName);
+    size_t benchDecode(const uint8_t* bytes, size_t size);
+    void benchWrite(const Sign& read);
+
+private:
+    Options options;
+    const Snippets snippets;
+    const WordTable& table;
+    Writer writer;
+    theTextFormat textFormat;
+    int state;
+    string line;
+    Sign sign;
+    uint32_t key;
+    Counts counted;
+
+    // Words we have already translated, by their parsed Sign.
+    unordered_map<string, string> cache;
+    vector<size_t> seen;
+    string cacheKey;
+    string cacheFile;
+    CacheFile disk;
+    const CacheFile* diskCache;
+    size_t cacheAdded;
+
+    // The signs of the document being converted, for --savebox.
+    unordered_map<string, SavedBox> boxes;
+    size_t boxesNamed;
+    bool counting;
+
+    // Set with onSign, and what feed has to keep for the next time.
+    SignHandler signHandler;
+    void* signContext;
+    uint8_t carried[blockHeadroom];
+    size_t carriedSize;
+
+    // With --incremental, the chunks of the last conversion of this file and
+    // its output, and the chunks of this one.
+    unordered_map<uint64_t, Chunk> previous;
+    MappedFile previousOutput;
+    vector<Chunk> chunks;
+
+    // Scratch space that is kept from word to word and from one conversion
+    // to the next, so that once it has grown to fit we stop allocating.
+    vector<uint8_t> block;
+    vector<uint32_t> chars;
+    vector< vector<int> > columns;
+
+    void restart(ostream* out);
+    void convertAll(const uint8_t* bytes, size_t size);
+    void countSigns(const uint8_t* bytes, size_t size);
+    void convertChunks(const uint8_t* bytes, size_t size);
+    void convertPieces(const uint8_t* bytes, size_t size);
+    static void convertPiece(const Conversion* whole, Piece* piece);
+    size_t convertBytes(const uint8_t* bytes, size_t size, bool atEnd);
+    size_t convertUtf8(const uint8_t* bytes, size_t size, bool atEnd);
+    void step(uint32_t c);
+    void finishInput();
+    void finishOutput();
+
+    void sendOut(uint32_t c);
+    void sendOut(string& l, uint32_t c);
+    void keep(uint32_t c);
+    void take(uint32_t c);
+    void addSymbol(int s);
+    void finishWord(uint32_t c);
+    void writeWord();
+    void writeBoxName(size_t name);
+    template <typename Number> void writeSymbol(Number x, Number y, int s);
+};
+
+
+namespace
+{
+
+/*
+    This parser works with as state machines within state machines.
+
+    There is also a general error state which says that we failed in our matching and need
+    to spit out what we have saved so far.
+
+    Our outer state machine has the following states:
+        Start       -- the obligatory starting state
+        Punctuation -- processing a punctuation sign (can be done visually as well)
+        Prefix      -- processing the temporal prefix (can be missing)
+        Visual      -- processing the visual layout of the sign (required)
+        End         -- Time to spit out what we have
+
+    The Punctuation state machine has the following states:
+        Symbol      -- processing a base symbol
+        Placement   -- processing the placement of the symbol
+        End         -- Time for the outer state machine to finish
+
+    The prefix state machine has the following states:
+        Start       -- the obligatory starting state
+        Symbol      -- processing a base symbol
+        End         -- If we used this state machine, time for the outer state machine to move to the next state
+
+    The visual state machine has the following states:
+        Start       -- the obligatory starting state
+        Size        -- processing the size of the word
+        Symbol      -- processing a base symbol
+        Placement   -- processing the placement of the symbol
+        End         -- Time for the outer state machine to finish
+
+    The Symbol state machine has the following states
+        Start       -- the obligatory starting state
+        FirstDigit  -- the first digit
+        SecondDigit -- the second digit
+        ThirdDigt   -- the third digit
+        Fill        -- the fill
+        Rotation    -- the rotation
+        End         -- Time for the outer state machine to finish
+
+    The Size state machine has the following states:
+        Start       -- the obligatory starting state
+        FirstW      -- the first digit of the width
+        SecondW     -- the second digit of the width
+        ThirdW      -- the third digit of the width
+        x           -- the letter `x'
+        FirstH      -- the first digit of the height
+        SecondH     -- the second digit of the height
+        ThirdH      -- the third digit of the height
+        End         -- Time for the outer state machine to finish
+
+    The Placement state machine is exactly the same as the size state machine
+*/
+
+/*
+    When it comes to processing, all of these machines are compiled into one
+    flat table (see WordTable). Every state of every machine, together with
+    the few places where what we accept depends on a digit we have already
+    seen (a width starting with 2 may only go on to 5-9, for instance),
+    becomes a single word state. Every character falls into one of a handful
+    of classes. Finding the next word state is then one step through
+    transitions[state][class] no matter how deep in the word we are.
+
+    Anything at or above a_pass in the table is an action rather than a state:
+        a_pass        -- not part of a word, send the character along
+        a_fail        -- the match failed, spit out what we stored and the character
+        a_done        -- the word is complete, translate it
+        a_punctuation -- a punctuation sign is complete; it is taken as though
+                         it were a visual word in the middle lane with a box of
+                         500x500 so that it can be translated the same way
+
+    Each state also has a role, which says what the character it accepts
+    means to the word: a lane, a digit of a symbol key, a digit of a
+    placement, and so on (see take). The word is filled in as it is read, so
+    translating it never has to look back at the characters.
+*/
+
+enum
+{
+    w_start,
+    w_punctuation_symbol_first,
+    w_punctuation_symbol_second,
+    w_punctuation_symbol_third,
+    w_punctuation_symbol_fill,
+    w_punctuation_symbol_rotation,
+    w_punctuation_placement_firstw,
+    w_punctuation_placement_secondw2,
+    w_punctuation_placement_secondw3,
+    w_punctuation_placement_secondw7,
+    w_punctuation_placement_thirdw,
+    w_punctuation_placement_x,
+    w_punctuation_placement_firsth,
+    w_punctuation_placement_secondh2,
+    w_punctuation_placement_secondh3,
+    w_punctuation_placement_secondh7,
+    w_punctuation_placement_thirdh,
+    w_punctuation_placement_end,
+    w_prefix_symbol_start,
+    w_prefix_symbol_first,
+    w_prefix_symbol_second12,
+    w_prefix_symbol_second3,
+    w_prefix_symbol_third,
+    w_prefix_symbol_third38,
+    w_prefix_symbol_third3f,
+    w_prefix_symbol_fill,
+    w_prefix_symbol_rotation,
+    w_visual_start,
+    w_visual_size_firstw,
+    w_visual_size_secondw2,
+    w_visual_size_secondw3,
+    w_visual_size_secondw7,
+    w_visual_size_thirdw,
+    w_visual_size_x,
+    w_visual_size_firsth,
+    w_visual_size_secondh2,
+    w_visual_size_secondh3,
+    w_visual_size_secondh7,
+    w_visual_size_thirdh,
+    w_visual_symbol_start,
+    w_visual_symbol_first,
+    w_visual_symbol_second12,
+    w_visual_symbol_second3,
+    w_visual_symbol_third,
+    w_visual_symbol_third38,
+    w_visual_symbol_fill,
+    w_visual_symbol_rotation,
+    w_visual_placement_firstw,
+    w_visual_placement_secondw2,
+    w_visual_placement_secondw3,
+    w_visual_placement_secondw7,
+    w_visual_placement_thirdw,
+    w_visual_placement_x,
+    w_visual_placement_firsth,
+    w_visual_placement_secondh2,
+    w_visual_placement_secondh3,
+    w_visual_placement_secondh7,
+    w_visual_placement_thirdh,
+    w_visual_placement_end,
+    w_states
+};
+
+const uint8_t a_pass = 0x80;
+const uint8_t a_fail = 0x81;
+const uint8_t a_done = 0x82;
+const uint8_t a_punctuation = 0x83;
+
+// What finishWord is given in place of the character after the word, when
+// the input has simply run out.
+const uint32_t endOfInput = 0xffffffff;
+
+
+/*
+    Now we come to reading.
+
+    If we want to be able to read from a wide variety of files, then we
+    have to be ready for all the different encodings and be able to convert
+    each of them into utf-32.
+
+    Reading a character at a time through istream::get costs us a call per
+    byte, so instead we read the input in large blocks and decode a whole
+    block into a run of utf-32 characters in one go. Before the first block
+    is decoded we look for a byte order mark to decide which format we have
+    (or default to utf8). We then have a set of functions to convert to
+    utf32(internal version) from all the other types of characters.
+
+    Utf8, which is what nearly everyone has, skips the run of utf-32
+    characters entirely. Its bytes go straight to the state machine, and only
+    the multi-byte characters (in practice, Unicode SignWriting) are decoded
+    as we come across them. See convertUtf8.
+
+    A character can straddle the end of a block, so whatever is left over
+    undecoded at the end of one block is carried to the front of the next.
+
+    Even though these are technically characters, because we are dealing
+    with SignWriting characters which are outside of plane-0 we are going
+    to pass them around as if they are unsigned integers anyway.
+*/
+
+size_t detectTextFormat(const uint8_t* bytes, size_t size, theTextFormat& textFormat);
+size_t decodeBlock(theTextFormat textFormat, const uint8_t* bytes, size_t size, bool atEnd, vector<uint32_t>& chars);
+
+size_t plainRun(const uint8_t* bytes, size_t size);
+size_t utf8Length(uint8_t lead);
+size_t decodeFixed(int (*toUtf32)(const uint8_t*, uint32_t*), const char* message,
+    const uint8_t* bytes, size_t size, bool atEnd, vector<uint32_t>& chars);
+
+int utf8ToUtf32(const uint8_t* c, uint32_t* fileOut);
+int utf16leToUtf32(const uint8_t* c, uint32_t* fileOut);
+int utf16beToUtf32(const uint8_t* c, uint32_t* fileOut);
+int utf32leToUtf32(const uint8_t* c, uint32_t* fileOut);
+int utf32beToUtf32(const uint8_t* c, uint32_t* fileOut);
+
+
+size_t detectTextFormat(const uint8_t* bytes, size_t size, theTextFormat& textFormat)
+{
+    // feff is the byte order
+    // In each format, this can serve as a key
+    // utf  8    ef bb bf
+    // utf 16 le ff fe
+    // utf 16 be fe ff
+    // utf 32 le ff fe 00 00
+    // utf 32 be 00 00 fe ff
+    // So we look for those, and if we don't see any of them we default to utf8.
+    // We return how many bytes of byte order mark to skip.
+    uint8_t charBuff[4] = { 0, 0, 0, 0 };
+    for (size_t i = 0; i < size && i < 4; i++)
+    {
+        charBuff[i] = bytes[i];
+    }
+    if (size >= 4 && charBuff[0] == 0x0 && charBuff[1] == 0x0 &&
+        charBuff[2] == 0xfe && charBuff[3] == 0xff)
+    {
+        textFormat = utf32be;
+        return 4;
+    }
+    else if (size >= 4 && charBuff[0] == 0xff && charBuff[1] == 0xfe &&
+        charBuff[2] == 0x0 && charBuff[3] == 0x0)
+    {
+        textFormat = utf32le;
+        return 4;
+    }
+    else if (charBuff[0] == 0xfe && charBuff[1] == 0xff)
+    {
+        textFormat = utf16be;
+        return 2;
+    }
+    else if (charBuff[0] == 0xff && charBuff[1] == 0xfe)
+    {
+        textFormat = utf16le;
+        return 2;
+    }
+    else if (charBuff[0] == 0xef && charBuff[1] == 0xbb &&
+        charBuff[2] == 0xbf)
+    {
+        textFormat = utf8;
+        return 3;
+    }
+    textFormat = utf8;
+    return 0;
+}
+
+// Decode as much of the block as we can and tell the caller how many bytes we used.
+// If this is the last block, a character cut off by the end of the file is dropped.
+size_t decodeBlock(theTextFormat textFormat, const uint8_t* bytes, size_t size, bool atEnd, vector<uint32_t>& chars)
+{
+    switch (textFormat)
+    {
+    case utf16le: return decodeFixed(utf16leToUtf32, "Badly formed utf16le string.", bytes, size, atEnd, chars);
+    case utf16be: return decodeFixed(utf16beToUtf32, "Badly formed utf16be string.", bytes, size, atEnd, chars);
+    case utf32le: return decodeFixed(utf32leToUtf32, "Badly formed utf32le string.", bytes, size, atEnd, chars);
+    case utf32be: return decodeFixed(utf32beToUtf32, "Badly formed utf32be string.", bytes, size, atEnd, chars);
+    default: throw "Utf8 is not decoded a block at a time.";
+    }
+}
+
+// How many bytes does the utf8 character starting with this byte take up?
+// None, if it can't start one at all.
+size_t utf8Length(uint8_t lead)
+{
+    if (lead < 0x80)
+        return 1;
+    if (lead < 0xc0 || lead >= 0xf8)
+        return 0;
+    if (lead >= 0xf0)
+        return 4;
+    if (lead >= 0xe0)
+        return 3;
+    return 2;
+}
+
+// Outside of a word the only bytes that matter are the ones that can begin
+// one: A, B, L, M, R, and S for fsw, and the 0xf0 lead byte of the swu prefix
+// and lanes. We stop at any byte with the high bit set, not just 0xf0, so that
+// the rest of non-ascii text still gets checked on its way through. How many
+// bytes from the front can go straight out?
+inline bool isTrigger(uint8_t b)
+{
+    return b >= 0x80 || b == 'A' || b == 'B' || b == 'L' || b == 'M' || b == 'R' || b == 'S';
+}
+
+size_t plainRun(const uint8_t* bytes, size_t size)
+{
+    size_t place = 0;
+#if defined(__AVX2__)
+    const __m256i a32 = _mm256_set1_epi8('A'), b32 = _mm256_set1_epi8('B');
+    const __m256i l32 = _mm256_set1_epi8('L'), m32 = _mm256_set1_epi8('M');
+    const __m256i r32 = _mm256_set1_epi8('R'), s32 = _mm256_set1_epi8('S');
+    for (; place + 32 <= size; place += 32)
+    {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + place));
+        __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, a32), _mm256_cmpeq_epi8(block, b32)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, l32), _mm256_cmpeq_epi8(block, m32)));
+        hits = _mm256_or_si256(hits,
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, r32), _mm256_cmpeq_epi8(block, s32)));
+        uint32_t found = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(hits, block)));
+        if (found != 0)
+            return place + __builtin_ctz(found);
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+    const __m128i a16 = _mm_set1_epi8('A'), b16 = _mm_set1_epi8('B');
+    const __m128i l16 = _mm_set1_epi8('L'), m16 = _mm_set1_epi8('M');
+    const __m128i r16 = _mm_set1_epi8('R'), s16 = _mm_set1_epi8('S');
+    for (; place + 16 <= size; place += 16)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + place));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, a16), _mm_cmpeq_epi8(block, b16)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, l16), _mm_cmpeq_epi8(block, m16)));
+        hits = _mm_or_si128(hits,
+            _mm_or_si128(_mm_cmpeq_epi8(block, r16), _mm_cmpeq_epi8(block, s16)));
+        uint32_t found = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(hits, block)));
+        if (found != 0)
+            return place + __builtin_ctz(found);
+    }
+#endif
+    while (place < size && !isTrigger(bytes[place]))
+        place++;
+    return place;
+}
+
+size_t decodeFixed(int (*toUtf32)(const uint8_t*, uint32_t*), const char* message,
+    const uint8_t* bytes, size_t size, bool atEnd, vector<uint32_t>& chars)
+{
+    size_t place = 0;
+    uint32_t result = 0;
+    while (size - place >= 4)
+    {
+        int length = toUtf32(bytes + place, &result);
+        if (length == 0)
+            throw message;
+        chars.push_back(result);
+        place += length;
+    }
+    // The last few bytes may only be the front of a character, so we pad
+    // them out with zeros and only take what actually fits.
+    while (place < size)
+    {
+        uint8_t charBuff[4] = { 0, 0, 0, 0 };
+        for (size_t i = 0; i < size - place; i++)
+        {
+            charBuff[i] = bytes[place + i];
+        }
+        int length = toUtf32(charBuff, &result);
+        if (length == 0 || static_cast<size_t>(length) > size - place)
+            break;
+        chars.push_back(result);
+        place += length;
+    }
+    if (atEnd)
+        return size;
+    return place;
+}
+
+/*
+    We always convert to utf-8 on output since we know that we are
+    outputting a lot of XeLaTeX code with expanded characters of the
+    format ``\char#xxxx''.
+
+    Everything we send out is gathered in the Writer's buffer and only
+    handed to the ostream when the buffer is full or the conversion is done,
+    so the ostream sees a few large writes instead of a call per piece of
+    text. Numbers are written straight into the buffer with to_chars, which
+    keeps them clear of the stream's locale handling.
+*/
+
+size_t encodeUtf8(char* to, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        to[0] = static_cast<char>(c);
+        return 1;
+    }
+    else if (c < 0x800)
+    {
+        to[0] = static_cast<char>(((c >> 6) & 0x1f) | 0xc0);
+        to[1] = static_cast<char>(((c >> 0) & 0x3f) | 0x80);
+        return 2;
+    }
+    else if (c < 0x10000)
+    {
+        to[0] = static_cast<char>(((c >> 12) & 0xf) | 0xe0);
+        to[1] = static_cast<char>(((c >> 6) & 0x3f) | 0x80);
+        to[2] = static_cast<char>(((c >> 0) & 0x3f) | 0x80);
+        return 3;
+    }
+    to[0] = static_cast<char>(((c >> 18) & 0x7) | 0xf0);
+    to[1] = static_cast<char>(((c >> 12) & 0x3f) | 0x80);
+    to[2] = static_cast<char>(((c >> 6) & 0x3f) | 0x80);
+    to[3] = static_cast<char>(((c >> 0) & 0x3f) | 0x80);
+    return 4;
+}
+
+void appendUtf8(string& to, uint32_t c)
+{
+    char buff[4];
+    to.append(buff, encodeUtf8(buff, c));
+}
+
+Writer::Writer()
+    : out(0), into(0), ring(0), buffer(writeSize), used(0), flushed(0)
+{
+}
+
+void Writer::begin(ostream* to)
+{
+    out = to;
+    into = 0;
+    ring = 0;
+    used = 0;
+    flushed = 0;
+}
+
+// Or the text can be kept in memory, on the end of a string.
+void Writer::begin(string* to)
+{
+    begin(static_cast<ostream*>(0));
+    into = to;
+}
+
+// Or it can be handed on through a ring, a buffer at a time.
+void Writer::begin(Ring* to)
+{
+    begin(static_cast<ostream*>(0));
+    ring = to;
+}
+
+// Tell whoever is at the other end of the ring that there is no more.
+void Writer::end()
+{
+    flush();
+    Block* block = ring->fill();
+    if (block == 0)
+        return;
+    block->size = 0;
+    block->last = true;
+    ring->filled();
+}
+
+void Writer::write(const char* text, size_t size)
+{
+    if (writeSize - used < size)
+    {
+        flush();
+        // Something this big may as well go straight out.
+        if (size >= writeSize && ring == 0)
+        {
+            if (out != 0)
+                out->write(text, size);
+            else if (into != 0)
+                into->append(text, size);
+            flushed += size;
+            return;
+        }
+    }
+    while (writeSize - used < size)
+    {
+        size_t part = writeSize - used;
+        memcpy(&buffer[used], text, part);
+        used += part;
+        text += part;
+        size -= part;
+        flush();
+    }
+    memcpy(&buffer[used], text, size);
+    used += size;
+}
+
+void Writer::put(char c)
+{
+    if (used == writeSize)
+        flush();
+    buffer[used++] = c;
+}
+
+void Writer::utf8(uint32_t c)
+{
+    if (writeSize - used < 4)
+        flush();
+    used += encodeUtf8(&buffer[used], c);
+}
+
+// With nowhere to send it (the counting pass of --savebox), the text is dropped.
+void Writer::flush()
+{
+    if (used > 0 && out != 0)
+        out->write(&buffer[0], used);
+    else if (used > 0 && into != 0)
+        into->append(&buffer[0], used);
+    else if (used > 0 && ring != 0)
+    {
+        // The block we hand on takes our buffer, and we take its old one,
+        // so nothing is copied.
+        Block* block = ring->fill();
+        if (block != 0)
+        {
+            block->bytes.swap(buffer);
+            block->size = used;
+            block->last = false;
+            ring->filled();
+        }
+    }
+    flushed += used;
+    used = 0;
+}
+
+// How much has been written since begin, whether or not it has gone out yet.
+size_t Writer::written() const
+{
+    return flushed + used;
+}
+
+// Whether what is written is just going to be dropped.
+bool Writer::discarding() const
+{
+    return out == 0 && into == 0 && ring == 0;
+}
+
+// Copy what was written after mark, as long as it is all still in the buffer.
+bool Writer::copySince(size_t mark, string& to) const
+{
+    if (mark < flushed)
+        return false;
+    to.assign(&buffer[mark - flushed], flushed + used - mark);
+    return true;
+}
+
+Writer& Writer::operator<<(const char* text)
+{
+    write(text, strlen(text));
+    return *this;
+}
+
+Writer& Writer::operator<<(const string& text)
+{
+    write(text.data(), text.size());
+    return *this;
+}
+
+Writer& Writer::operator<<(int n)
+{
+    // No int takes more than 11 characters.
+    if (writeSize - used < 11)
+        flush();
+    used = to_chars(&buffer[used], &buffer[0] + writeSize, n).ptr - &buffer[0];
+    return *this;
+}
+
+// Lengths in points are written with at most four places after the decimal
+// point, which is already finer than TeX itself keeps them.
+size_t formatPoints(char* to, double points)
+{
+    char* end = to_chars(to, to + 32, points, chars_format::fixed, 4).ptr;
+    while (end[-1] == '0')
+        end--;
+    if (end[-1] == '.')
+        end--;
+    if (end - to == 2 && to[0] == '-' && to[1] == '0')
+    {
+        to[0] = '0';
+        end = to + 1;
+    }
+    return end - to;
+}
+
+Writer& Writer::operator<<(double points)
+{
+    if (writeSize - used < 32)
+        flush();
+    used += formatPoints(&buffer[used], points);
+    return *this;
+}
+
+}
+
+// And now we send it out
+void Conversion::sendOut(uint32_t c)
+{
+    if (c < 0x80)
+        writer.put(static_cast<char>(c));
+    else
+        writer.utf8(c);
+}
+
+// The stored part of a word is already utf8, so it goes out as it is.
+void Conversion::sendOut(string& l, uint32_t c)
+{
+    writer.write(l.data(), l.size());
+    sendOut(c);
+    l.clear();
+    state = w_start;
+}
+
+namespace
+{
+
+// Now that we have been using all those ``convert to uft32'', let's define them.
+
+int utf8ToUtf32(const uint8_t* coming, uint32_t* going)
+{
+    // Quick review:
+    //    0xxx xxxx
+    //    110x xxxx  10xx xxxx
+    //    1110 xxxx  10xx xxxx  10xx xxxx
+    //    1111 -xxx  10xx xxxx  10xx xxxx  10xx xxxx
+    if ((coming[0] & 0xf0) == 0xf0)
+    {
+        going[0] = coming[0] & 0x7;
+        for (int i = 1; i < 4; i++)
+        {
+            if ((coming[i] & 0xc0) != 0x80)
+                return 0;
+            going[0] <<= 6;
+            going[0] |= (coming[i] & 0x3f);
+        }
+        return 4;
+    }
+    if ((coming[0] & 0xf0) == 0xe0)
+    {
+        going[0] = coming[0] & 0xf;
+        for (int i = 1; i < 3; i++)
+        {
+            if ((coming[i] & 0xc0) != 0x80)
+                return 0;
+            going[0] <<= 6;
+            going[0] |= (coming[i] & 0x3f);
+        }
+        return 3;
+    }
+    if ((coming[0] & 0xe0) == 0xc0)
+    {
+        going[0] = coming[0] & 0x1f;
+        for (int i = 1; i < 2; i++)
+        {
+            if ((coming[i] & 0xc0) != 0x80)
+                return 0;
+            going[0] <<= 6;
+            going[0] |= (coming[i] & 0x3f);
+        }
+        return 2;
+    }
+    if ((coming[0] & 0xc0) == 0x80)
+    {
+        throw "Malformed utf8 string.";
+    }
+    going[0] = coming[0];
+    return 1;
+}
+
+int utf16leToUtf32(const uint8_t* coming, uint32_t* going)
+{
+    // Quick review, after accounting for endianess
+    // 0000--d7ff = pass along
+    // d800--d8ff = a following dc00-dfff tells the low 10 bits
+    // dc00--dfff = better be following d800-d8ff
+    // e000--ffff = pass along
+    going[0] = coming[0] << 0;
+    going[0] |= coming[1] << 8;
+    if (going[0] < 0xd800)
+        return 2;
+    if (going[0] < 0xdc00)
+    {
+        if (coming[3] < 0xdc || coming[3]>0xdf)
+            return 0;
+        // The pair holds the code point less 0x10000, so add it back in.
+        going[0] &= 0x3ff;
+        going[0] += 0x40;
+        going[0] <<= 10;
+        going[0] |= coming[2];
+        going[0] |= (coming[3] & 0x3) << 8;
+        return 4;
+    }
+    if (going[0] < 0xe000)
+        throw "Malformed utf16le string";
+    return 2;
+}
+
+int utf16beToUtf32(const uint8_t* coming, uint32_t* going)
+{
+    // Quick review, after accounting for endianess
+    // 0000--d7ff = pass along
+    // d800--d8ff = a following dc00-dfff tells the low 10 bits
+    // dc00--dfff = better be following d800-d8ff
+    going[0] = coming[0] << 8;
+    going[0] |= coming[1] << 0;
+    if (going[0] < 0xd800)
+        return 2;
+    if (going[0] < 0xdc00)
+    {
+        if (coming[2] < 0xdc || coming[2]>0xdf)
+            return 0;
+        // The pair holds the code point less 0x10000, so add it back in.
+        going[0] &= 0x3ff;
+        going[0] += 0x40;
+        going[0] <<= 10;
+        going[0] |= (coming[2] & 0x3) << 8;
+        going[0] |= coming[3];
+        return 4;
+    }
+    if (going[0] < 0xe000)
+        throw "Malformed utf16le string";
+    return 2;
+}
+
+int utf32leToUtf32(const uint8_t* coming, uint32_t* going)
+{
+    going[0] = coming[0] << 0;
+    going[0] |= coming[1] << 8;
+    going[0] |= coming[2] << 16;
+    going[0] |= coming[3] << 24;
+    return 4;
+}
+
+int utf32beToUtf32(const uint8_t* coming, uint32_t* going)
+{
+    going[0] = coming[0] << 24;
+    going[0] |= coming[1] << 16;
+    going[0] |= coming[2] << 8;
+    going[0] |= coming[3] << 0;
+    return 4;
+}
+
+
+}
+
+/*
+    Now we have our state processing.
+    Every character (a uint32_t which represents the Unicode character in
+    question) is looked up in the word table from the state we are in. There
+    are three possible results from being in a state and receiving a character.
+    1) Move forward to a new state.
+    2) Notice an error and spit out the currently stored data unchanged.
+    3) Notice that the match is complete and translate it.
+
+    By far the largest part of the table is moving forward to a new state, and
+    every entry we don't fill in is an error. In the two end states, though,
+    the ``error'' is actually a successful completion and we do a translation.
+
+    Our storage and state management are all part of Conversion up above.
+
+    One final note, this SignWriting converter is actually too permissive.
+    In this converter you can use unicode for the symbol and ``text'' for
+    the numbers, or the reverse. I believe that you should actually be
+    required to do one or the other, but there it is. If I were ever to make a
+    version that did not let you mix and match FSWA and FSWU, we would have two
+    sets of tables.
+
+    It's may also not be permissive enough in that if you have "AS123M", it may
+    miss that M starts a word. I didn't bother testing for this behavior. I also
+    don't look through a partially accepted string to see if a new one should
+    start so if you say "M500x500S10000500x500S" then this is a failure and the
+    first portion will not be translated.
+
+    Each of these states tells us what is being expected. So, for instance,
+    w_start is expecting to see a word start. If it doesn't, then it just sends
+    the character along. But w_visual_size_secondw3 is expecting the second digit
+    of the number expressing the width, having seen a first digit of 3 to 6. If it
+    doesn't get one, then it will need to spit out what it has already stored and
+    then go back to start.
+
+    What we have accepted so far is kept in line as utf8, exactly as it will
+    be sent out again if the match fails. At the same time, take works out
+    what each character means and puts it in sign, so that when the match is
+    complete we already have the lane, the prefix, and every symbol with its
+    placement as plain numbers.
+*/
+
+void Conversion::keep(uint32_t c)
+{
+    if (c < 0x80)
+        line.push_back(static_cast<char>(c));
+    else
+        appendUtf8(line, c);
+}
+
+/*
+    The input can arrive two ways. Standard in (or anything else that isn't a
+    plain file) is read a block at a time through an istream. A plain file is
+    mapped into memory instead, which saves copying it through the iostream
+    buffer and lets the kernel read ahead for us. Either way, convertBytes
+    decodes a stretch of bytes and runs the state machine over it, and
+    finishOutput writes the suggestions that go at the bottom.
+*/
+
+Conversion::Conversion(const Options& options)
+    : options(options), snippets(options), table(wordTable()), textFormat(unknown), state(w_start),
+      sign(), key(0), seen(seenSize), diskCache(&disk), cacheAdded(0), boxesNamed(0), counting(false),
+      signHandler(0), signContext(0), carriedSize(0)
+{
+}
+
+Snippets::Snippets(const Options& options)
+{
+    // A length with an @ in its name can only be used inside \makeatletter.
+    bool hasat = options.fsize.find('@') != string::npos;
+    string fsize = "\\" + options.fsize;
+    string rotate = "rotate=" + to_string(options.rotation);
+    string picture = "\\begin{tikzpicture}";
+    if ((options.rotation != 0) || (options.mirror == true))
+        picture += "[";
+    if (options.rotation != 0)
+        picture += rotate;
+    if ((options.rotation != 0) && (options.mirror == true))
+        picture += ",";
+    if (options.mirror == true)
+        picture += "yscale=-1";
+    if ((options.rotation != 0) || (options.mirror == true))
+        picture += "]";
+    wordStart = "{";
+    if (hasat)
+        wordStart += "\\makeatletter";
+    wordStart += picture;
+    wordEnd = "\\end{tikzpicture}}";
+    // The idea was, initially, to place a thin rectangle behind each word from 0--1000.
+    // Unfortunately, this made it so that I could reasonably fit about two columns of
+    // \normalsize text to a page. We are now only extend 100 each direction to allow for about
+    // five columns of \normalsize text. This also decided our lane shift amount later on.
+
+    // Yes, I know the number 100 doesn't appear. That's because I found through experimentation
+    // that a character anchored at (0,0) along with a rectangle around (0,0) does not place a
+    // rectangle around the expected corner.
+    laneBox = "\\draw[white](" + fsize + "/30*-90 pt," + fsize + "/30*-12 pt)rectangle(" + fsize +
+        "/30*110 pt," + fsize + "/30*-10 pt);";
+    at = "\\draw(" + fsize + "/30*";
+    comma = " pt," + fsize + "/30*";
+
+    // With --ptsize we know what \f@size is going to be, so we work the
+    // lengths out here and TeX gets plain numbers of points.
+    if (options.ptsize > 0)
+    {
+        char number[32];
+        string corners[4];
+        int sizes[4] = { -90, -12, 110, -10 };
+        for (int i = 0; i < 4; i++)
+            corners[i].assign(number, formatPoints(number, sizes[i] * options.ptsize / 30));
+        laneBox = "\\draw[white](" + corners[0] + " pt," + corners[1] + " pt)rectangle(" + corners[2] +
+            " pt," + corners[3] + " pt);";
+        at = "\\draw(";
+        comma = " pt,";
+    }
+
+    // The options every node gets, whether it is a symbol or a spelled symbol.
+    string node;
+    if (options.mirror == true)
+        node += "xscale=-1";
+    if ((options.mirror == true) && (options.rotation != 0))
+        node += ",";
+    if (options.rotation != 0)
+        node += rotate;
+    if ((options.rotation != 0) || (options.mirror == true))
+        node += ",";
+    string fontsize;
+    if (options.fsize != Options().fsize)
+        fontsize = "\\fontsize{" + fsize + "}{" + fsize + "}\\selectfont";
+    fillNode = " pt) node [" + node + "color=white,anchor=north west] {\\swfill" + fontsize + "\\char";
+    lineNode = " pt) node [" + node + "anchor=north west] {\\swline" + fontsize + "\\char";
+
+    // With --merge, each symbol is a single node. The fill glyph is put down
+    // in white without taking up any width, and the line glyph is drawn over
+    // it from the same spot, just as the two separate nodes would have done.
+    if (options.merge)
+    {
+        fillNode = " pt) node [" + node + "anchor=north west] {\\rlap{\\color{white}\\swfill" + fontsize + "\\char";
+        lineNode = "}\\swline" + fontsize + "\\char";
+    }
+    spellNode = "\\draw(0,0) rectangle (12pt,12pt);\\draw(0,13pt) node [" + node +
+        "anchor=north west] {\\swline\\fontsize{6pt}{6pt}\\selectfont\\char";
+
+    // With --compact, all of the above is said once, in macros, and each word
+    // and symbol only names the macro. \swsym takes the x, the y, and the
+    // symbol number counted from S10000, and adds on where each font starts.
+    if (options.compact)
+    {
+        if (hasat)
+            definitions += "\\makeatletter\n";
+        definitions += "\\newcommand{\\swword}[1]{{" + picture + "#1" + wordEnd + "}\n";
+        definitions += "\\newcommand{\\swlane}{" + laneBox + "}\n";
+        definitions += "\\newcommand{\\swsym}[3]{" + at + "#1" + comma + "#2" + fillNode + "\\numexpr1048577+#3\\relax";
+        if (!options.merge)
+            definitions += "};" + at + "#1" + comma + "#2";
+        definitions += lineNode + "\\numexpr983041+#3\\relax};}\n";
+        if (hasat)
+            definitions += "\\makeatother\n";
+        wordStart = "\\swword{";
+        wordEnd = "}";
+        laneBox = "\\swlane";
+    }
+}
+
+const Counts& Conversion::counts() const
+{
+    return counted;
+}
+
+// A new conversion. With --savebox, which signs get a box is only worked out
+// by fswtotex, which reads the whole input first and then restarts; nothing
+// is kept from one conversion to the next.
+void Conversion::begin(ostream* out)
+{
+    boxes.clear();
+    boxesNamed = 0;
+    counting = false;
+    restart(out);
+}
+
+void Conversion::restart(ostream* out)
+{
+    writer.begin(out);
+    textFormat = unknown;
+    state = w_start;
+    line.clear();
+    counted = Counts();
+    carriedSize = 0;
+    if (block.size() < blockSize)
+        block.resize(blockSize);
+    chars.reserve(blockSize);
+}
+
+// A character cut off by the end of one piece is finished off a byte at a
+// time from the start of the next one, and so are the first few bytes,
+// which might be a byte order mark. The rest of each piece is converted
+// right where it is.
+void Conversion::feed(const uint8_t* bytes, size_t size)
+{
+    while (size > 0 && (carriedSize > 0 || textFormat == unknown))
+    {
+        carried[carriedSize++] = *bytes++;
+        size--;
+        if (textFormat == unknown && carriedSize < 4)
+            continue;
+        size_t place = convertBytes(carried, carriedSize, false);
+        carriedSize -= place;
+        memmove(carried, carried + place, carriedSize);
+    }
+    if (size == 0)
+        return;
+    size_t place = convertBytes(bytes, size, false);
+    carriedSize = size - place;
+    memcpy(carried, bytes + place, carriedSize);
+}
+
+void Conversion::finish()
+{
+    convertBytes(carried, carriedSize, true);
+    carriedSize = 0;
+    finishOutput();
+}
+
+void Conversion::onSign(SignHandler handler, void* context)
+{
+    signHandler = handler;
+    signContext = context;
+}
+
+int Conversion::fswtotex(istream* fileIn, ostream* out)
+{
+    if (options.savebox || options.incremental)
+    {
+        // Both passes, or all the chunks, need the whole input, so we read
+        // it all in first.
+        vector<uint8_t> whole((istreambuf_iterator<char>(*fileIn)), istreambuf_iterator<char>());
+        if (!whole.empty())
+            return fswtotex(&whole[0], whole.size(), out);
+    }
+    else if (options.pipeline && out != 0)
+    {
+        // Without an ostream, there would be nothing for the writing thread
+        // to write to.
+        return fswtotexPipelined(fileIn, out);
+    }
+    begin(out);
+    uint8_t* bytes = &block[0];
+    size_t kept = 0;
+    bool atEnd = false;
+    while (!atEnd)
+    {
+        fileIn->read(reinterpret_cast<char*>(&bytes[kept]), blockSize - kept);
+        size_t size = kept + static_cast<size_t>(fileIn->gcount());
+        atEnd = !(*fileIn);
+        size_t place = convertBytes(bytes, size, atEnd);
+        kept = size - place;
+        for (size_t i = 0; i < kept; i++)
+            bytes[i] = bytes[place + i];
+    }
+    finishOutput();
+    return 0;
+}
+
+int Conversion::fswtotex(const uint8_t* bytes, size_t size, ostream* out)
+{
+    if (options.savebox)
+    {
+        countSigns(bytes, size);
+        restart(out);
+    }
+    else
+    {
+        begin(out);
+    }
+    if (options.incremental)
+        convertChunks(bytes, size);
+    else if (options.threads > 1 && !options.savebox)
+        convertPieces(bytes, size);
+    else
+        convertAll(bytes, size);
+    finishOutput();
+    return 0;
+}
+
+void Conversion::convertAll(const uint8_t* bytes, size_t size)
+{
+    // We still go a block at a time so the decoded characters stay in cache.
+    size_t place = 0;
+    do
+    {
+        size_t length = size - place;
+        bool atEnd = true;
+        if (length > blockSize)
+        {
+            length = blockSize;
+            atEnd = false;
+        }
+        place += convertBytes(bytes + place, length, atEnd);
+    } while (place < size);
+}
+
+// The first pass of --savebox, which only counts how often each sign comes
+// up. Nothing is written.
+void Conversion::countSigns(const uint8_t* bytes, size_t size)
+{
+    begin(0);
+    counting = true;
+    try
+    {
+        convertAll(bytes, size);
+        finishInput();
+    }
+    catch (...)
+    {
+        counting = false;
+        throw;
+    }
+    counting = false;
+}
+
+int Conversion::fswtotex(const string& fileName, ostream* out)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw "Unable to open the input file.";
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0 ||
+        (options.pipeline && !options.savebox && !options.incremental))
+    {
+        // Pipes and the like can't be mapped, and neither can an empty file.
+        // With --pipeline we read the file a block at a time on its own thread.
+        close(fd);
+        fstream fin;
+        fin.open(fileName, ios::in);
+        return fswtotex(&fin, out);
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        fstream fin;
+        fin.open(fileName, ios::in);
+        return fswtotex(&fin, out);
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    int result;
+    try
+    {
+        result = fswtotex(static_cast<const uint8_t*>(mapped), size, out);
+    }
+    catch (...)
+    {
+        munmap(mapped, size);
+        throw;
+    }
+    munmap(mapped, size);
+    return result;
+}
+
+namespace
+{
+
+Ring::Ring(size_t blockBytes)
+    : blocks(ringBlocks), filling(0), draining(0), stopped(false), sleepers(0)
+{
+    for (size_t i = 0; i < ringBlocks; i++)
+        blocks[i].bytes.resize(blockBytes);
+}
+
+// The next empty block to put something in, or 0 if the ring was stopped.
+Block* Ring::fill()
+{
+    size_t next = filling.load(memory_order_relaxed);
+    while (next - draining.load(memory_order_acquire) == blocks.size())
+    {
+        if (stopped.load(memory_order_acquire))
+            return 0;
+        sleep(draining, next - blocks.size());
+    }
+    return &blocks[next % blocks.size()];
+}
+
+void Ring::filled()
+{
+    filling.store(filling.load(memory_order_relaxed) + 1);
+    wake();
+}
+
+// The next full block to take out, or 0 if the ring was stopped.
+Block* Ring::drain()
+{
+    size_t next = draining.load(memory_order_relaxed);
+    while (next == filling.load(memory_order_acquire))
+    {
+        if (stopped.load(memory_order_acquire))
+            return 0;
+        sleep(filling, next);
+    }
+    return &blocks[next % blocks.size()];
+}
+
+void Ring::drained()
+{
+    draining.store(draining.load(memory_order_relaxed) + 1);
+    wake();
+}
+
+void Ring::stop()
+{
+    stopped.store(true);
+    wake();
+}
+
+// Sleep while the other side's count is still where it was. We say we are
+// asleep before we look at the count one last time, and the other side
+// moves its count before it looks for sleepers, so one of us always sees
+// the other and the wake up can't be missed.
+void Ring::sleep(const atomic<size_t>& count, size_t until)
+{
+    unique_lock<mutex> locked(sleeping);
+    sleepers++;
+    while (count.load() == until && !stopped.load())
+        moved.wait(locked);
+    sleepers--;
+}
+
+void Ring::wake()
+{
+    if (sleepers.load() == 0)
+        return;
+    lock_guard<mutex> locked(sleeping);
+    moved.notify_all();
+}
+
+void readBlocks(istream* fileIn, Ring* input)
+{
+    bool atEnd = false;
+    while (!atEnd)
+    {
+        Block* block = input->fill();
+        if (block == 0)
+            return;
+        fileIn->read(&block->bytes[blockHeadroom], blockSize);
+        block->size = static_cast<size_t>(fileIn->gcount());
+        block->last = atEnd = !(*fileIn);
+        input->filled();
+    }
+}
+
+void writeBlocks(ostream* out, Ring* output)
+{
+    bool atEnd = false;
+    while (!atEnd)
+    {
+        Block* block = output->drain();
+        if (block == 0)
+            return;
+        out->write(&block->bytes[0], block->size);
+        atEnd = block->last;
+        output->drained();
+    }
+}
+
+}
+
+/*
+    The same as reading from a stream, but the reading and the writing are
+    done by threads of their own, so that waiting on a slow pipe or disk
+    doesn't hold up the conversion. The few bytes a block ends with that
+    convertBytes couldn't use yet (part of a character) are put in front of
+    the next block, in the room that was left there for them.
+*/
+
+int Conversion::fswtotexPipelined(istream* fileIn, ostream* out)
+{
+    Ring input(blockHeadroom + blockSize);
+    Ring output(writeSize);
+    begin(out);
+    writer.begin(&output);
+    thread reading(readBlocks, fileIn, &input);
+    thread writing(writeBlocks, out, &output);
+    uint8_t carried[blockHeadroom];
+    size_t kept = 0;
+    bool atEnd = false;
+    try
+    {
+        while (!atEnd)
+        {
+            Block* block = input.drain();
+            uint8_t* bytes = reinterpret_cast<uint8_t*>(&block->bytes[blockHeadroom - kept]);
+            memcpy(bytes, carried, kept);
+            size_t size = kept + block->size;
+            atEnd = block->last;
+            size_t place = convertBytes(bytes, size, atEnd);
+            kept = size - place;
+            memcpy(carried, bytes + place, kept);
+            input.drained();
+        }
+        finishOutput();
+    }
+    catch (...)
+    {
+        input.stop();
+        writer.end();
+        reading.join();
+        writing.join();
+        writer.begin(out);
+        throw;
+    }
+    writer.end();
+    reading.join();
+    writing.join();
+    writer.begin(out);
+    return 0;
+}
+
+// Decode what we can of these bytes, run it through the state machine,
+// and report how many bytes we used. Anything but utf8 is decoded a block
+// at a time, however much we are given, so that chars never grows past a
+// block. A character cut off by the end of one block is simply decoded
+// again from the start of the next.
+size_t Conversion::convertBytes(const uint8_t* bytes, size_t size, bool atEnd)
+{
+    size_t place = 0;
+    try
+    {
+        if (textFormat == unknown)
+            place = detectTextFormat(bytes, size, textFormat);
+        if (textFormat == utf8)
+            return place + convertUtf8(bytes + place, size - place, atEnd);
+        do
+        {
+            size_t length = min(size - place, blockSize);
+            bool last = place + length == size;
+            size_t used = decodeBlock(textFormat, bytes + place, length, atEnd && last, chars);
+            for (size_t i = 0; i < chars.size(); i++)
+                step(chars[i]);
+            chars.clear();
+            place += used;
+            if (last)
+                break;
+        } while (place < size);
+    }
+    catch (...)
+    {
+        // Whatever we converted before the bad input still goes out.
+        chars.clear();
+        writer.flush();
+        throw;
+    }
+    return place;
+}
+
+// Utf8 is fed to the state machine a byte at a time, but only near a word.
+// Between words everything up to the next byte that could start one goes out
+// in a single write; anything that isn't ascii is decoded on the spot.
+size_t Conversion::convertUtf8(const uint8_t* bytes, size_t size, bool atEnd)
+{
+    size_t place = 0;
+    uint32_t result = 0;
+    while (place < size)
+    {
+        if (state == w_start)
+        {
+            size_t run = plainRun(bytes + place, size - place);
+            if (run > 0)
+            {
+                writer.write(reinterpret_cast<const char*>(bytes + place), run);
+                place += run;
+                if (place == size)
+                    break;
+            }
+        }
+        if (bytes[place] < 0x80)
+        {
+            step(bytes[place]);
+            place++;
+            continue;
+        }
+        size_t length = utf8Length(bytes[place]);
+        if (length == 0)
+            throw "Badly formed utf8 string.";
+        if (size - place < length)
+        {
+            // Cut off by the end of what we were given: the rest may be in
+            // the next piece, but not if there is none.
+            if (atEnd)
+                throw "Badly formed utf8 string.";
+            break;
+        }
+        if (utf8ToUtf32(bytes + place, &result) != static_cast<int>(length))
+            throw "Badly formed utf8 string.";
+        step(result);
+        place += length;
+    }
+    return place;
+}
+
+void Conversion::finishOutput()
+{
+    finishInput();
+    writer << "\n";
+    writer << "% In order for this conversion to work your document needs a few things around "
+        "your SignWriting text." << "\n";
+    writer << "\n";
+    writer << "\\documentclass{article}" << "\n";
+    writer << "\n";
+    writer << "\\usepackage{fontspec}" << "\n";
+    writer << "\\usepackage{tikz}" << "\n";
+    if ((options.rotation == -90) || (options.rotation == 90))
+        writer << "\\usepackage[landscape]{geometry}" << "\n";
+    if (options.mirror)
+        writer << "\\usepackage[mirror]{crop}" << "\n";
+    if (options.rotation != 0)
+    {
+        writer << "\\usepackage{everypage}" << "\n";
+        writer << "\\AddEverypageHook{\\special{pdf: put @thispage <</Rotate " << options.rotation << ">>}}" << "\n";
+    }
+    writer << "\n";
+    writer << "\\begin{document}" << "\n";
+    writer << "\n";
+    writer << "\\newfontfamily\\swfill{SuttonSignWritingFill.ttf}" << "\n";
+    writer << "\\newfontfamily\\swline{SuttonSignWritingLine.ttf}" << "\n";
+    if (options.fsize != Options().fsize)
+    {
+        writer << "\\newlength{\\" << options.fsize << "}" << "\n";
+        writer << "\\setlength{\\" << options.fsize << "}{12pt}" << "\n";
+    }
+    writer << snippets.definitions;
+    writer << "\n";
+    writer << "% SignWriting text goes here" << "\n";
+    writer << "\n";
+    writer << "\\end{document}" << "\n";
+    writer.flush();
+}
+
+namespace
+{
+
+/*
+    The character classes. Each digit gets its own class since the ranges we
+    accept differ from digit to digit. The lane letters all behave the same,
+    as do 'A' and the Unicode prefix marker, so each of those share a class
+    with their Unicode equivalents.
+*/
+
+enum
+{
+    c_0, c_1, c_2, c_3, c_4, c_5, c_6, c_7, c_8, c_9,
+    c_ab,       // a-b
+    c_ce,       // c-e
+    c_f,        // f
+    c_x,        // x
+    c_prefix,   // A or U+1D800
+    c_lane,     // B, L, M, R or U+1D801-U+1D804
+    c_s,        // S
+    c_number,   // U+1D80C-U+1D9FF
+    c_symbol,   // U+40001-U+4F428
+    c_other,
+    c_classes
+};
+
+/*
+    The roles. A role belongs to the state that accepts the character, since
+    the state is what tells us, for example, that a digit is the second
+    digit of a placement rather than of a size. The heads are where something
+    new begins: the prefix, a lane, an S key, or a whole Unicode symbol.
+*/
+
+enum
+{
+    r_none,
+    r_head,
+    r_key,          // a hex digit of an S key
+    r_rotation,     // the last hex digit, which completes the key
+    r_width_first,  // the first digit, or a Unicode number, of the box size
+    r_width,
+    r_height_first,
+    r_height,
+    r_x_first,      // the first digit, or a Unicode number, of a placement
+    r_x,
+    r_y_first,
+    r_y
+};
+
+struct WordTable
+{
+    uint8_t asciiClass[0x80];
+    uint8_t transitions[w_states][c_classes];
+    uint8_t roles[w_states];
+
+    WordTable();
+    void allow(int from, const char* chars, uint8_t to);
+    void allow(int from, int charClass, uint8_t to);
+    void number(int firstw, int secondw2, int secondw3, int secondw7, int thirdw, int x,
+        int firsth, int secondh2, int secondh3, int secondh7, int thirdh, uint8_t after,
+        uint8_t firstRole);
+    void symbol(int first, int last, uint8_t rotation);
+};
+
+const WordTable& wordTable()
+{
+    static const WordTable table;
+    return table;
+}
+
+inline uint8_t charClass(const WordTable& table, uint32_t c)
+{
+    if (c < 0x80)
+        return table.asciiClass[c];
+    if (c == 0x1d800)
+        return c_prefix;
+    if (c >= 0x1d801 && c <= 0x1d804)
+        return c_lane;
+    if (c >= 0x1d80c && c <= 0x1d9ff)
+        return c_number;
+    if (c >= 0x40001 && c <= 0x4f428)
+        return c_symbol;
+    return c_other;
+}
+
+void WordTable::allow(int from, const char* chars, uint8_t to)
+{
+    for (; *chars; chars++)
+        transitions[from][asciiClass[static_cast<uint8_t>(*chars)]] = to;
+}
+
+void WordTable::allow(int from, int charClass, uint8_t to)
+{
+    transitions[from][charClass] = to;
+}
+
+// A pair of numbers (a size or a placement), written either as 3 digits, an
+// `x', and 3 digits or as two Unicode numbers. Each number runs from 250 to 749.
+// firstRole is r_width_first or r_x_first, and the other roles follow it.
+void WordTable::number(int firstw, int secondw2, int secondw3, int secondw7, int thirdw, int x,
+    int firsth, int secondh2, int secondh3, int secondh7, int thirdh, uint8_t after,
+    uint8_t firstRole)
+{
+    roles[firstw] = firstRole;
+    roles[secondw2] = roles[secondw3] = roles[secondw7] = roles[thirdw] = firstRole + 1;
+    roles[firsth] = firstRole + 2;
+    roles[secondh2] = roles[secondh3] = roles[secondh7] = roles[thirdh] = firstRole + 3;
+    allow(firstw, "2", secondw2);
+    allow(firstw, "3456", secondw3);
+    allow(firstw, "7", secondw7);
+    allow(firstw, c_number, firsth);
+    allow(secondw2, "56789", thirdw);
+    allow(secondw3, "0123456789", thirdw);
+    allow(secondw7, "01234", thirdw);
+    allow(thirdw, "0123456789", x);
+    allow(x, "x", firsth);
+    allow(firsth, "2", secondh2);
+    allow(firsth, "3456", secondh3);
+    allow(firsth, "7", secondh7);
+    allow(firsth, c_number, after);
+    allow(secondh2, "56789", thirdh);
+    allow(secondh3, "0123456789", thirdh);
+    allow(secondh7, "01234", thirdh);
+    allow(thirdh, "0123456789", after);
+}
+
+// The states of a symbol key are declared together, from the first digit
+// through to the rotation.
+void WordTable::symbol(int first, int last, uint8_t rotation)
+{
+    for (int i = first; i < last; i++)
+        roles[i] = r_key;
+    roles[last] = rotation;
+}
+
+WordTable::WordTable()
+{
+    const char* digits = "0123456789";
+    for (int i = 0; i < 0x80; i++)
+        asciiClass[i] = c_other;
+    for (int i = 0; i < 10; i++)
+        asciiClass[static_cast<int>(digits[i])] = static_cast<uint8_t>(c_0 + i);
+    asciiClass['a'] = asciiClass['b'] = c_ab;
+    asciiClass['c'] = asciiClass['d'] = asciiClass['e'] = c_ce;
+    asciiClass['f'] = c_f;
+    asciiClass['x'] = c_x;
+    asciiClass['A'] = c_prefix;
+    asciiClass['B'] = asciiClass['L'] = asciiClass['M'] = asciiClass['R'] = c_lane;
+    asciiClass['S'] = c_s;
+
+    // Unless we say otherwise, a character ends the match in failure.
+    for (int i = 0; i < w_states; i++)
+    {
+        roles[i] = r_none;
+        for (int j = 0; j < c_classes; j++)
+            transitions[i][j] = a_fail;
+    }
+    roles[w_start] = roles[w_prefix_symbol_start] = roles[w_visual_start] = r_head;
+    roles[w_visual_symbol_start] = roles[w_punctuation_placement_end] = r_head;
+    roles[w_visual_placement_end] = r_head;
+    symbol(w_punctuation_symbol_first, w_punctuation_symbol_rotation, r_rotation);
+    symbol(w_prefix_symbol_first, w_prefix_symbol_rotation, r_rotation);
+    symbol(w_visual_symbol_first, w_visual_symbol_rotation, r_rotation);
+
+    // Start
+    for (int j = 0; j < c_classes; j++)
+        transitions[w_start][j] = a_pass;
+    allow(w_start, c_prefix, w_prefix_symbol_start);
+    allow(w_start, c_lane, w_visual_size_firstw);
+    allow(w_start, c_s, w_punctuation_symbol_first);
+
+    // Punctuation, which is always S387 through S38b
+    allow(w_punctuation_symbol_first, "3", w_punctuation_symbol_second);
+    allow(w_punctuation_symbol_second, "8", w_punctuation_symbol_third);
+    allow(w_punctuation_symbol_third, "789ab", w_punctuation_symbol_fill);
+    allow(w_punctuation_symbol_fill, "012345", w_punctuation_symbol_rotation);
+    allow(w_punctuation_symbol_rotation, "0123456789abcdef", w_punctuation_placement_firstw);
+    number(w_punctuation_placement_firstw, w_punctuation_placement_secondw2,
+        w_punctuation_placement_secondw3, w_punctuation_placement_secondw7,
+        w_punctuation_placement_thirdw, w_punctuation_placement_x, w_punctuation_placement_firsth,
+        w_punctuation_placement_secondh2, w_punctuation_placement_secondh3,
+        w_punctuation_placement_secondh7, w_punctuation_placement_thirdh, a_punctuation, r_x_first);
+    for (int j = 0; j < c_classes; j++)
+        transitions[w_punctuation_placement_end][j] = a_done;
+    allow(w_punctuation_placement_end, c_s, w_punctuation_symbol_first);
+    allow(w_punctuation_placement_end, c_symbol, w_visual_placement_firstw);
+
+    // Prefix, where the symbols run from S100 through S38b, along with S3ff
+    allow(w_prefix_symbol_start, c_s, w_prefix_symbol_first);
+    allow(w_prefix_symbol_start, c_symbol, w_visual_start);
+    allow(w_prefix_symbol_first, "12", w_prefix_symbol_second12);
+    allow(w_prefix_symbol_first, "3", w_prefix_symbol_second3);
+    allow(w_prefix_symbol_second12, "0123456789abcdef", w_prefix_symbol_third);
+    allow(w_prefix_symbol_second3, "01234567", w_prefix_symbol_third);
+    allow(w_prefix_symbol_second3, "8", w_prefix_symbol_third38);
+    allow(w_prefix_symbol_second3, "f", w_prefix_symbol_third3f);
+    allow(w_prefix_symbol_third, "0123456789abcdef", w_prefix_symbol_fill);
+    allow(w_prefix_symbol_third38, "0123456789ab", w_prefix_symbol_fill);
+    allow(w_prefix_symbol_third3f, "f", w_prefix_symbol_fill);
+    allow(w_prefix_symbol_fill, "012345", w_prefix_symbol_rotation);
+    allow(w_prefix_symbol_rotation, "0123456789abcdef", w_visual_start);
+
+    // Visual, which may be more of the prefix
+    allow(w_visual_start, c_lane, w_visual_size_firstw);
+    allow(w_visual_start, c_s, w_prefix_symbol_first);
+    allow(w_visual_start, c_symbol, w_visual_start);
+    number(w_visual_size_firstw, w_visual_size_secondw2, w_visual_size_secondw3,
+        w_visual_size_secondw7, w_visual_size_thirdw, w_visual_size_x, w_visual_size_firsth,
+        w_visual_size_secondh2, w_visual_size_secondh3, w_visual_size_secondh7,
+        w_visual_size_thirdh, w_visual_symbol_start, r_width_first);
+    allow(w_visual_symbol_start, c_s, w_visual_symbol_first);
+    allow(w_visual_symbol_start, c_symbol, w_visual_placement_firstw);
+    allow(w_visual_symbol_first, "12", w_visual_symbol_second12);
+    allow(w_visual_symbol_first, "3", w_visual_symbol_second3);
+    allow(w_visual_symbol_second12, "0123456789abcdef", w_visual_symbol_third);
+    allow(w_visual_symbol_second3, "01234567", w_visual_symbol_third);
+    allow(w_visual_symbol_second3, "8", w_visual_symbol_third38);
+    allow(w_visual_symbol_third, "0123456789abcdef", w_visual_symbol_fill);
+    allow(w_visual_symbol_third38, "0123456789ab", w_visual_symbol_fill);
+    allow(w_visual_symbol_fill, "012345", w_visual_symbol_rotation);
+    allow(w_visual_symbol_rotation, "0123456789abcdef", w_visual_placement_firstw);
+    number(w_visual_placement_firstw, w_visual_placement_secondw2, w_visual_placement_secondw3,
+        w_visual_placement_secondw7, w_visual_placement_thirdw, w_visual_placement_x,
+        w_visual_placement_firsth, w_visual_placement_secondh2, w_visual_placement_secondh3,
+        w_visual_placement_secondh7, w_visual_placement_thirdh, w_visual_placement_end, r_x_first);
+    for (int j = 0; j < c_classes; j++)
+        transitions[w_visual_placement_end][j] = a_done;
+    allow(w_visual_placement_end, c_s, w_visual_symbol_first);
+    allow(w_visual_placement_end, c_symbol, w_visual_placement_firstw);
+}
+
+}
+
+void Conversion::step(uint32_t c)
+{
+    uint8_t next = table.transitions[state][charClass(table, c)];
+    if (next < w_states)
+    {
+        keep(c);
+        take(c);
+        state = next;
+    }
+    else if (next == a_pass)
+        sendOut(c);
+    else if (next == a_fail)
+        sendOut(line, c);
+    else if (next == a_done)
+        finishWord(c);
+    else // if (next == a_punctuation)
+    {
+        keep(c);
+        take(c);
+        state = w_punctuation_placement_end;
+    }
+}
+
+// A word is only finished by whatever comes after it, so at the end of the
+// input we finish it ourselves: a word that is whole is translated, just as
+// if a space came next, and anything else we were holding on to goes out
+// as it was.
+void Conversion::finishInput()
+{
+    if (state == w_start)
+        return;
+    if (table.transitions[state][charClass(table, ' ')] == a_done)
+    {
+        finishWord(endOfInput);
+        return;
+    }
+    writer.write(line.data(), line.size());
+    line.clear();
+    state = w_start;
+}
+
+namespace
+{
+
+inline int hexValue(uint32_t c)
+{
+    return (c <= '9') ? c - '0' : c - 'a' + 10;
+}
+
+// A number either starts with a digit or is a single Unicode number.
+inline int numberValue(uint32_t c)
+{
+    return (c < 0x80) ? c - '0' : c - 0x1d80c + 250;
+}
+
+}
+
+void Conversion::take(uint32_t c)
+{
+    switch (table.roles[state])
+    {
+    case r_head:
+        if (state == w_start)
+        {
+            sign.lane = 0;
+            sign.prefix.clear();
+            sign.symbols.clear();
+        }
+        if (c == 'S')
+        {
+            key = 0;
+            if (state == w_start)
+            {
+                sign.lane = 'M';
+                sign.width = 500;
+                sign.height = 500;
+            }
+        }
+        else if (c >= 0x40001)
+            addSymbol(c - 0x40001);
+        else if (c >= 0x1d801 && c <= 0x1d804)
+            sign.lane = "BLMR"[c - 0x1d801];
+        else if (c < 0x80 && c != 'A')
+            sign.lane = static_cast<char>(c);
+        break;
+    case r_key:
+        key = key * 16 + hexValue(c);
+        break;
+    case r_rotation:
+        key = key * 16 + hexValue(c);
+        // The key is now the base symbol followed by the fill and rotation
+        // digits, and each base symbol has 6 fills of 16 rotations.
+        addSymbol(((key >> 8) - 0x100) * (6 * 16) + (key & 0xff));
+        break;
+    case r_width_first:
+        sign.width = numberValue(c);
+        break;
+    case r_width:
+        sign.width = sign.width * 10 + (c - '0');
+        break;
+    case r_height_first:
+        sign.height = numberValue(c);
+        break;
+    case r_height:
+        sign.height = sign.height * 10 + (c - '0');
+        break;
+    case r_x_first:
+        sign.symbols.back().x = numberValue(c);
+        break;
+    case r_x:
+        sign.symbols.back().x = sign.symbols.back().x * 10 + (c - '0');
+        break;
+    case r_y_first:
+        sign.symbols.back().y = numberValue(c);
+        break;
+    case r_y:
+        sign.symbols.back().y = sign.symbols.back().y * 10 + (c - '0');
+        break;
+    }
+}
+
+// Symbols before the lane are the prefix; the rest are placed in the box.
+void Conversion::addSymbol(int s)
+{
+    if (sign.lane == 0)
+    {
+        sign.prefix.push_back(s);
+    }
+    else
+    {
+        Placed placed = { s, 0, 0 };
+        sign.symbols.push_back(placed);
+    }
+}
+
+/*
+    The same words come up again and again (a glossary, a drill), and the
+    options don't change in the middle of a conversion, so a word with the
+    same lane, prefix, symbols and placements always comes out the same.
+    The key is the parsed Sign laid out as raw bytes, and what we keep is the
+    text the word turned into.
+
+    Keeping a copy of every word costs more than translating it, so a word
+    only goes in the cache the second time we see it. The first time, all we
+    note is the hash of its key, in a table where a later word may simply
+    take its place. A word whose text didn't fit in the Writer's buffer in
+    one piece is just translated again the next time.
+
+    With --cache the words are also kept on disk between runs, so every word
+    goes in the cache the first time. See loadCache.
+
+    That saves us the work, but xelatex still builds every copy of a word
+    from scratch. With --savebox we go through the document twice. The
+    first time we only count the signs, by the same key. The second time,
+    a sign that comes up more than once is built into a box where it first
+    appears, and every copy of it, that one included, is just that box.
+    The box is filled with \setbox rather than \sbox, which would read the
+    whole word as an argument before the \makeatletter in it took effect.
+    A box is drawn once, at whatever size the text is where it is filled, so
+    every copy comes out that size, wherever it is.
+*/
+
+void Conversion::finishWord(uint32_t c)
+{
+    state = w_start;
+    cacheKey.assign(1, sign.lane);
+    uint16_t prefixes = static_cast<uint16_t>(sign.prefix.size());
+    cacheKey.append(reinterpret_cast<const char*>(&prefixes), sizeof(prefixes));
+    cacheKey.append(reinterpret_cast<const char*>(sign.prefix.data()), sign.prefix.size() * sizeof(int));
+    cacheKey.append(reinterpret_cast<const char*>(sign.symbols.data()), sign.symbols.size() * sizeof(Placed));
+    if (counting)
+    {
+        boxes[cacheKey].uses++;
+        line.clear();
+        return;
+    }
+    counted.words++;
+    if (signHandler != 0)
+        signHandler(sign, line, signContext);
+    line.clear();
+    if (writer.discarding())
+        return;
+    if (options.savebox)
+    {
+        unordered_map<string, SavedBox>::iterator saved = boxes.find(cacheKey);
+        if (saved != boxes.end() && saved->second.uses > 1 &&
+            (saved->second.name != 0 || boxesNamed < boxLimit))
+        {
+            if (saved->second.name == 0)
+            {
+                saved->second.name = ++boxesNamed;
+                writer << "\\newsavebox{";
+                writeBoxName(saved->second.name);
+                writer << "}\\global\\setbox";
+                writeBoxName(saved->second.name);
+                writer << "\\hbox{";
+                counted.misses++;
+                writeWord();
+                writer << "}";
+            }
+            else
+            {
+                counted.hits++;
+            }
+            writer << "\\usebox{";
+            writeBoxName(saved->second.name);
+            writer << "}";
+            if (c != endOfInput)
+                sendOut(c);
+            return;
+        }
+    }
+    size_t hashed = hash<string>()(cacheKey);
+    size_t& slot = seen[hashed % seenSize];
+    if (slot != hashed && cacheFile.empty())
+    {
+        slot = hashed;
+        counted.misses++;
+        writeWord();
+    }
+    else
+    {
+        slot = hashed;
+        unordered_map<string, string>::const_iterator found = cache.find(cacheKey);
+        const CacheSlot* stored = 0;
+        if (found != cache.end())
+        {
+            counted.hits++;
+            writer << found->second;
+        }
+        else if ((stored = diskCache->find(cacheKey)) != 0)
+        {
+            counted.hits++;
+            writer.write(diskCache->text(stored), stored->textLength);
+        }
+        else
+        {
+            counted.misses++;
+            size_t mark = writer.written();
+            writeWord();
+            if (cache.size() < cacheLimit)
+            {
+                string& text = cache[cacheKey];
+                if (writer.copySince(mark, text))
+                    cacheAdded++;
+                else
+                    cache.erase(cacheKey);
+            }
+        }
+    }
+    if (c != endOfInput)
+        sendOut(c);
+}
+
+// Control sequences can't have digits in them, so the boxes are named with
+// letters: \swboxa, \swboxb, ..., \swboxz, \swboxba, and so on.
+void Conversion::writeBoxName(size_t name)
+{
+    char letters[16];
+    size_t size = 0;
+    for (name--; size == 0 || name > 0; name /= 26)
+        letters[size++] = static_cast<char>('a' + name % 26);
+    writer << "\\swbox";
+    while (size > 0)
+        writer.put(letters[--size]);
+}
+
+void Conversion::writeWord()
+{
+    // We currently ignore the height and width.
+    writer << snippets.wordStart;
+    if (sign.lane != 'B')
+        writer << snippets.laneBox;
+    if (options.spelling)
+    {
+        // The columns are kept from word to word, so rather than resizing them
+        // we count how many this word uses and empty each one as it comes up.
+        size_t used = 0;
+        for (size_t i = 0; i < sign.prefix.size(); i++)
+        {
+            int s = sign.prefix[i];
+            size_t wanted = used;
+            if (s == (0x387 - 0x100) * (6 * 16))
+                wanted = used + 1;
+            else if (s == (0x388 - 0x100) * (6 * 16))
+                wanted = used + 2;
+            else if (used == 0)
+                wanted = 1;
+            if (columns.size() < wanted)
+                columns.resize(wanted);
+            for (; used < wanted; used++)
+                columns[used].clear();
+            if (s != (0x387 - 0x100) * (6 * 16) && s != (0x388 - 0x100) * (6 * 16))
+                columns[used - 1].push_back(s);
+        }
+        int maxsize = 0;
+        for (size_t x = 0; x < used; x++)
+        {
+            if (static_cast<int>(columns[x].size()) > maxsize)
+                maxsize = columns[x].size();
+        }
+        int leftofword = 0;
+        for (size_t i = 0; i < sign.symbols.size(); i++)
+        {
+            if (sign.symbols[i].x - 500 < leftofword)
+                leftofword = sign.symbols[i].x - 500;
+        }
+        for (int x = 0; x < static_cast<int>(used); x++)
+        {
+            for (int y = 0; y < static_cast<int>(columns[x].size()); y++)
+            {
+                // zitzelsberger
+                writer << "\\begin{scope}[xshift=" << (x * 12 - 7 * static_cast<int>(used - 1) - (1 * static_cast<int>(used % 2)) + leftofword - 15) << "pt, yshift=" << ((maxsize / 2 - y - 2) * 12) << "pt]";
+                writer << snippets.spellNode << (0xf0001 + columns[x][y]) << "};";
+                writer << "\\end{scope}";
+            }
+        }
+    }
+    for (size_t i = 0; i < sign.symbols.size(); i++)
+    {
+        int s = sign.symbols[i].symbol;
+        int sx = sign.symbols[i].x;
+        int sy = sign.symbols[i].y;
+        /*
+        At this point, assuming well formed F/USW strings, we will
+        Have a symbol centered around (500,500).
+        For 'B' (meaning horizontal SW) we center it around (0,0).
+        For 'L' we shift it left 250.
+        For 'M' it is correct.
+        For 'R' we shift it right 250.
+        */
+        if (sign.lane == 'B')
+            sx -= 500;
+        if (sign.lane == 'L')
+            sx -= 550;
+        if (sign.lane == 'M')
+            sx -= 500;
+        if (sign.lane == 'R')
+            sx -= 450;
+        sy -= 500;
+        // Now we know where, but for SignWriting the white space can be important too.
+        if (options.ptsize > 0)
+            writeSymbol(sx * options.ptsize / 30, -sy * options.ptsize / 30, s);
+        else
+            writeSymbol(sx, -sy, s);
+    }
+    writer << snippets.wordEnd;
+}
+
+/*
+    The cache on disk is one file per set of options in the --cache
+    directory. The file is named for a hash of the options and of this
+    build of fswtotex, since a change to either changes what a word turns
+    into. It starts with those same options written out, in case two sets
+    of them ever hash alike.
+
+    After that comes a hash table, so that a run can map the file in and
+    look words up where they are rather than reading the whole thing in
+    first. Each slot has the hash of a key, where the key and its text are in
+    the file, and how long each is; a slot with no key is empty. The keys and
+    texts themselves come after the table. The table always has an empty
+    slot, so a look up always comes to an end. Just before the table are its
+    size and a checksum of the table. Each slot has a checksum of its own
+    key and text, which is only checked the first time the word is looked
+    up, so that opening the file doesn't mean reading all of it.
+
+    Several runs can share the directory. Nobody ever writes to the file
+    itself: saving writes a whole new file under a temporary name and then
+    renames it into place, which either happens completely or not at all.
+    Before saving we take in whatever another run saved since we started,
+    so each run only adds to the cache. If two runs save at the same moment,
+    one run's new words may be lost, but they are just translated again
+    next time. Within one run (--batch, or --serve) the converters take
+    turns to save, and each save has a temporary file of its own.
+
+    Anything wrong with the file (too short, a different header, a slot
+    pointing past the end, a full table, a table checksum that doesn't
+    match) means we go without it, and a word whose own checksum doesn't
+    match is translated again. The cache is only ever a shortcut.
+*/
+
+namespace
+{
+
+string cacheHeader(const Options& options)
+{
+    string header = "fswtotex cache 3, built " __DATE__ " " __TIME__ "\nfsize=" + options.fsize +
+        " mirror=" + to_string(options.mirror) + " rotation=" + to_string(options.rotation) +
+        " spelling=" + to_string(options.spelling) + " compact=" + to_string(options.compact) +
+        " merge=" + to_string(options.merge) + " ptsize=" + to_string(options.ptsize) + "\n";
+    // Pad it out so the table that follows is aligned.
+    header.resize((header.size() + 7) / 8 * 8, '\n');
+    return header;
+}
+
+// FNV-1a, which is the same from one build to the next. A hash can be
+// carried on over more text by passing it back in.
+uint64_t fnv(const char* text, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= static_cast<uint8_t>(text[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+CacheFile::~CacheFile()
+{
+    close();
+}
+
+void CacheFile::close()
+{
+    if (mapped != 0)
+        munmap(mapped, size);
+    mapped = 0;
+    size = 0;
+    slots = 0;
+    slotCount = 0;
+    checked.reset();
+}
+
+bool CacheFile::open(const string& fileName, const string& header)
+{
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < header.size() + sizeof(uint64_t))
+    {
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(info.st_size);
+    mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        mapped = 0;
+        return false;
+    }
+    const char* bytes = static_cast<const char*>(mapped);
+    uint64_t checksum = 0;
+    memcpy(&slotCount, bytes + header.size(), sizeof(slotCount));
+    memcpy(&checksum, bytes + header.size() + sizeof(slotCount), sizeof(checksum));
+    size_t table = header.size() + sizeof(slotCount) + sizeof(checksum);
+    if (size < table || memcmp(bytes, header.data(), header.size()) != 0 || slotCount == 0 ||
+        (slotCount & (slotCount - 1)) != 0 || (size - table) / sizeof(CacheSlot) < slotCount ||
+        fnv(bytes + table, slotCount * sizeof(CacheSlot)) != checksum)
+    {
+        close();
+        return false;
+    }
+    slots = reinterpret_cast<const CacheSlot*>(bytes + table);
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < slotCount; i++)
+    {
+        if (slots[i].place > size || size - slots[i].place < uint64_t(slots[i].keyLength) + slots[i].textLength)
+        {
+            close();
+            return false;
+        }
+        if (slots[i].keyLength != 0)
+            used++;
+    }
+    if (used >= slotCount)
+    {
+        close();
+        return false;
+    }
+    checked.reset(new atomic<uint8_t>[slotCount]());
+    return true;
+}
+
+// Whether the key and text of a slot are what was saved. Checking the same
+// slot twice at once does no harm, since both come to the same answer.
+bool CacheFile::sound(uint64_t i) const
+{
+    uint8_t state = checked[i].load(memory_order_relaxed);
+    if (state == 0)
+    {
+        const char* bytes = static_cast<const char*>(mapped) + slots[i].place;
+        state = fnv(bytes, uint64_t(slots[i].keyLength) + slots[i].textLength) == slots[i].checksum ? 1 : 2;
+        checked[i].store(state, memory_order_relaxed);
+    }
+    return state == 1;
+}
+
+const CacheSlot* CacheFile::find(const string& key) const
+{
+    if (slots == 0)
+        return 0;
+    uint64_t hash = fnv(key.data(), key.size());
+    uint64_t i = hash & (slotCount - 1);
+    for (uint64_t probes = 0; probes < slotCount && slots[i].keyLength != 0; probes++, i = (i + 1) & (slotCount - 1))
+    {
+        if (slots[i].hash == hash && slots[i].keyLength == key.size() &&
+            memcmp(static_cast<const char*>(mapped) + slots[i].place, key.data(), key.size()) == 0)
+            return sound(i) ? &slots[i] : 0;
+    }
+    return 0;
+}
+
+const char* CacheFile::text(const CacheSlot* slot) const
+{
+    return static_cast<const char*>(mapped) + slot->place + slot->keyLength;
+}
+
+}
+
+void Conversion::loadCache()
+{
+    if (options.cache.empty())
+        return;
+    mkdir(options.cache.c_str(), 0777);
+    string header = cacheHeader(options);
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.swcache", static_cast<unsigned long long>(fnv(header.data(), header.size())));
+    cacheFile = options.cache + name;
+    disk.open(cacheFile, header);
+}
+
+namespace
+{
+
+mutex cacheSaving;
+size_t cacheSaves = 0;
+
+}
+
+void Conversion::saveCache()
+{
+    if (cacheFile.empty() || cacheAdded == 0)
+        return;
+    lock_guard<mutex> saving(cacheSaving);
+    // Start again from what is there now, which may be newer than what we loaded.
+    string header = cacheHeader(options);
+    disk.open(cacheFile, header);
+    vector<CacheSlot> entries;
+    vector<const char*> from;
+    for (uint64_t i = 0; i < disk.slotCount; i++)
+    {
+        if (disk.slots[i].keyLength != 0 && disk.sound(i))
+        {
+            entries.push_back(disk.slots[i]);
+            from.push_back(static_cast<const char*>(disk.mapped) + disk.slots[i].place);
+        }
+    }
+    vector<string> added;
+    for (unordered_map<string, string>::const_iterator i = cache.begin(); i != cache.end(); ++i)
+    {
+        if (disk.find(i->first) != 0)
+            continue;
+        added.push_back(i->first + i->second);
+        CacheSlot slot = { fnv(i->first.data(), i->first.size()), 0,
+            static_cast<uint32_t>(i->first.size()), static_cast<uint32_t>(i->second.size()),
+            fnv(added.back().data(), added.back().size()) };
+        entries.push_back(slot);
+        from.push_back(0);
+    }
+    uint64_t slotCount = 16;
+    while (slotCount < entries.size() * 2)
+        slotCount *= 2;
+    vector<CacheSlot> table(slotCount, CacheSlot());
+    uint64_t place = header.size() + 2 * sizeof(uint64_t) + slotCount * sizeof(CacheSlot);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        entries[i].place = place;
+        place += entries[i].keyLength + entries[i].textLength;
+        uint64_t j = entries[i].hash & (slotCount - 1);
+        while (table[j].keyLength != 0)
+            j = (j + 1) & (slotCount - 1);
+        table[j] = entries[i];
+    }
+    uint64_t checksum = fnv(reinterpret_cast<const char*>(&table[0]), slotCount * sizeof(CacheSlot));
+
+    string temporary = cacheFile + "." + to_string(getpid()) + "." + to_string(cacheSaves++) + ".tmp";
+    ofstream fout(temporary, ios::out | ios::binary | ios::trunc);
+    fout << header;
+    fout.write(reinterpret_cast<const char*>(&slotCount), sizeof(slotCount));
+    fout.write(reinterpret_cast<const char*>(&checksum), sizeof(checksum));
+    fout.write(reinterpret_cast<const char*>(&table[0]), slotCount * sizeof(CacheSlot));
+    size_t next = 0;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (from[i] != 0)
+            fout.write(from[i], entries[i].keyLength + entries[i].textLength);
+        else
+            fout << added[next++];
+    }
+    fout.close();
+    disk.close();
+    if (!fout || rename(temporary.c_str(), cacheFile.c_str()) != 0)
+        remove(temporary.c_str());
+    else
+        cacheAdded = 0;
+    disk.open(cacheFile, header);
+}
+
+/*
+    A big file can be converted on several threads at once. Just as with
+    --incremental, a word never spans a line, so the state machine is always
+    back at w_start after a newline and whatever follows converts the same
+    on its own as it would have in the middle of the file. So we cut the
+    file into one piece per thread, each piece ending at a newline, and give
+    every piece but the first a converter of its own that writes to memory.
+    The first piece we convert ourselves, straight out, and then we write
+    the others out after it in order. The output is the same as going
+    through the file in one go, down to the byte, even when there is bad
+    input: everything before the bad byte goes out, and then we fail.
+
+    Like --incremental, this is only for utf8, since anywhere else a newline
+    byte might be the middle of a character.
+
+    With --cache, every piece looks words up in the cache file we loaded,
+    and the words they translate are added to ours afterwards, to be saved
+    with the rest. With onSign, we go through the file in one go, so that
+    the signs are handed over one at a time and in order.
+*/
+
+void Conversion::convertPieces(const uint8_t* bytes, size_t size)
+{
+    size_t place = detectTextFormat(bytes, size, textFormat);
+    size_t count = min(options.threads, (size - place) / pieceMinimum);
+    if (textFormat != utf8 || count < 2 || signHandler != 0)
+    {
+        textFormat = unknown;
+        convertAll(bytes, size);
+        return;
+    }
+    vector<Piece> pieces(count);
+    size_t start = place;
+    for (size_t i = 0; i < count && start < size; i++)
+    {
+        size_t end = size;
+        if (i + 1 < count)
+        {
+            size_t target = max(start, place + (size - place) / count * (i + 1));
+            const void* newline = memchr(bytes + target, '\n', size - target);
+            if (newline != 0)
+                end = static_cast<const uint8_t*>(newline) - bytes + 1;
+        }
+        pieces[i].bytes = bytes + start;
+        pieces[i].size = end - start;
+        start = end;
+    }
+
+    vector<thread> running;
+    for (size_t i = 1; i < count; i++)
+        running.push_back(thread(convertPiece, this, &pieces[i]));
+    try
+    {
+        convertUtf8(pieces[0].bytes, pieces[0].size, true);
+    }
+    catch (...)
+    {
+        writer.flush();
+        for (size_t i = 0; i < running.size(); i++)
+            running[i].join();
+        throw;
+    }
+    for (size_t i = 1; i < count; i++)
+    {
+        running[i - 1].join();
+        writer.write(pieces[i].text.data(), pieces[i].text.size());
+        counted.words += pieces[i].counted.words;
+        counted.hits += pieces[i].counted.hits;
+        counted.misses += pieces[i].counted.misses;
+        for (unordered_map<string, string>::iterator j = pieces[i].cache.begin();
+            j != pieces[i].cache.end() && cache.size() < cacheLimit; ++j)
+        {
+            if (cache.insert(*j).second)
+                cacheAdded++;
+        }
+        string().swap(pieces[i].text);
+        if (pieces[i].failure != 0)
+        {
+            writer.flush();
+            for (size_t j = i; j < running.size(); j++)
+                running[j].join();
+            throw pieces[i].failure;
+        }
+    }
+}
+
+void Conversion::convertPiece(const Conversion* whole, Piece* piece)
+{
+    // This runs on a thread of its own, so nothing may get out of it.
+    try
+    {
+        Options single = whole->options;
+        single.threads = 1;
+        Conversion converter(single);
+        converter.cacheFile = whole->cacheFile;
+        converter.diskCache = &whole->disk;
+        converter.begin(static_cast<ostream*>(0));
+        // Words come out around ten times the size they went in, and growing
+        // the string as we go would copy it over and over. Past a few
+        // megabytes the copying hardly matters, though, and every piece is
+        // held until its turn to be written.
+        piece->text.reserve(min(piece->size * 12, pieceReserve));
+        converter.writer.begin(&piece->text);
+        converter.textFormat = utf8;
+        try
+        {
+            converter.convertUtf8(piece->bytes, piece->size, true);
+            converter.finishInput();
+        }
+        catch (char const* message)
+        {
+            piece->failure = message;
+        }
+        converter.writer.flush();
+        piece->counted = converter.counted;
+        if (!converter.cacheFile.empty())
+            piece->cache.swap(converter.cache);
+    }
+    catch (char const* message)
+    {
+        piece->failure = message;
+    }
+    catch (...)
+    {
+        piece->failure = "Unexpected failure.";
+    }
+}
+
+/*
+    With --incremental, converting a file again after a small change only
+    converts the part that changed. The input is split into chunks of whole
+    lines, and a word never spans a line, so each chunk turns into the same
+    text wherever it is and whatever comes before it. Where a chunk ends is
+    decided by the lines themselves, so an edit only moves the ends of the
+    chunks around it and the rest of the file splits just as it did before.
+
+    Next to the output goes an index (the output's name with .swindex on
+    the end) of the hash and size of each chunk and where its text is in
+    the output. Next time, a chunk with the same hash and size is copied
+    from the old output rather than converted. The index also holds the
+    options, just like a cache file, and the size and time of the output it
+    describes, so that if the output has been touched since, we ignore it.
+
+    This only works for utf8 (and so ascii). Anything else is converted in
+    full, and gets an empty index.
+*/
+
+void Conversion::convertChunks(const uint8_t* bytes, size_t size)
+{
+    chunks.clear();
+    size_t place = detectTextFormat(bytes, size, textFormat);
+    if (textFormat != utf8)
+    {
+        textFormat = unknown;
+        convertAll(bytes, size);
+        return;
+    }
+    while (place < size)
+    {
+        Chunk chunk = { fnv(0, 0), 0, writer.written(), 0 };
+        size_t end = place;
+        uint64_t lineHash;
+        do
+        {
+            const void* newline = memchr(bytes + end, '\n', size - end);
+            size_t lineEnd = newline ? static_cast<const uint8_t*>(newline) - bytes + 1 : size;
+            lineHash = fnv(reinterpret_cast<const char*>(bytes + end), lineEnd - end);
+            chunk.hash = fnv(reinterpret_cast<const char*>(&lineHash), sizeof(lineHash), chunk.hash);
+            end = lineEnd;
+        } while (end < size && (lineHash & chunkMask) != 0 && end - place < chunkLimit);
+        chunk.size = end - place;
+
+        unordered_map<uint64_t, Chunk>::const_iterator old = previous.find(chunk.hash);
+        if (old != previous.end() && old->second.size == chunk.size)
+            writer.write(previousOutput.bytes + old->second.place, old->second.length);
+        else
+        {
+            convertUtf8(bytes + place, chunk.size, true);
+            finishInput();
+        }
+        chunk.length = writer.written() - chunk.place;
+        chunks.push_back(chunk);
+        place = end;
+    }
+}
+
+namespace
+{
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+void MappedFile::close()
+{
+    if (bytes != 0)
+        munmap(const_cast<char*>(bytes), size);
+    bytes = 0;
+    size = 0;
+}
+
+bool MappedFile::open(const string& fileName)
+{
+    close();
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(0, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+        return false;
+    bytes = static_cast<const char*>(mapped);
+    size = static_cast<size_t>(info.st_size);
+    return true;
+}
+
+// What the index says about the output it goes with.
+struct IndexStamp
+{
+    uint64_t size;
+    int64_t seconds;
+    int64_t nanoseconds;
+    uint64_t chunkCount;
+};
+
+bool stampOutput(const string& outName, IndexStamp& stamp)
+{
+    struct stat info;
+    if (stat(outName.c_str(), &info) != 0)
+        return false;
+    stamp.size = static_cast<uint64_t>(info.st_size);
+    stamp.seconds = info.st_mtim.tv_sec;
+    stamp.nanoseconds = info.st_mtim.tv_nsec;
+    return true;
+}
+
+}
+
+void Conversion::loadIndex(const string& outName)
+{
+    previous.clear();
+    previousOutput.close();
+    ifstream fin(outName + ".swindex", ios::in | ios::binary);
+    string header = cacheHeader(options);
+    string found(header.size(), '\0');
+    IndexStamp stamp, now;
+    if (!fin.read(&found[0], found.size()) || found != header ||
+        !fin.read(reinterpret_cast<char*>(&stamp), sizeof(stamp)) || !stampOutput(outName, now) ||
+        stamp.size != now.size || stamp.seconds != now.seconds || stamp.nanoseconds != now.nanoseconds ||
+        !previousOutput.open(outName) || previousOutput.size != stamp.size)
+    {
+        previousOutput.close();
+        return;
+    }
+    for (uint64_t i = 0; i < stamp.chunkCount; i++)
+    {
+        Chunk chunk;
+        if (!fin.read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) ||
+            chunk.place > stamp.size || stamp.size - chunk.place < chunk.length)
+        {
+            previous.clear();
+            previousOutput.close();
+            return;
+        }
+        previous[chunk.hash] = chunk;
+    }
+}
+
+void Conversion::saveIndex(const string& outName)
+{
+    previous.clear();
+    previousOutput.close();
+    IndexStamp stamp;
+    if (!stampOutput(outName, stamp))
+        return;
+    stamp.chunkCount = chunks.size();
+    string indexName = outName + ".swindex";
+    string temporary = indexName + "." + to_string(getpid()) + ".tmp";
+    ofstream fout(temporary, ios::out | ios::binary | ios::trunc);
+    fout << cacheHeader(options);
+    fout.write(reinterpret_cast<const char*>(&stamp), sizeof(stamp));
+    if (!chunks.empty())
+        fout.write(reinterpret_cast<const char*>(&chunks[0]), chunks.size() * sizeof(Chunk));
+    fout.close();
+    if (!fout || rename(temporary.c_str(), indexName.c_str()) != 0)
+        remove(temporary.c_str());
+}
+
+// The coordinates are either whole numbers for TeX to scale, or with
+// --ptsize, lengths we have already scaled ourselves.
+/*
+    For fswbench, the two ends of a conversion on their own. benchDecode
+    decodes text that isn't utf8 into utf-32 a block at a time, just as
+    convertBytes does, but doesn't go on to look for signs in it. benchWrite
+    writes a sign that has already been read, just as when the state machine
+    finishes one, cache and all.
+*/
+
+size_t Conversion::benchDecode(const uint8_t* bytes, size_t size)
+{
+    textFormat = unknown;
+    size_t place = detectTextFormat(bytes, size, textFormat);
+    size_t decoded = 0;
+    while (place < size)
+    {
+        size_t length = min(size - place, blockSize);
+        size_t used = decodeBlock(textFormat, bytes + place, length, place + length == size, chars);
+        decoded += chars.size();
+        chars.clear();
+        if (used == 0)
+            break;
+        place += used;
+    }
+    return decoded;
+}
+
+void Conversion::benchWrite(const Sign& read)
+{
+    sign = read;
+    line.clear();
+    finishWord(endOfInput);
+}
+
+template <typename Number> void Conversion::writeSymbol(Number x, Number y, int s)
+{
+    if (options.compact)
+    {
+        writer << "\\swsym{" << x << "}{" << y << "}{" << s << "}";
+        return;
+    }
+    writer << snippets.at << x << snippets.comma << y << snippets.fillNode << (0x100001 + s);
+    if (!options.merge)
+        writer << "};" << snippets.at << x << snippets.comma << y;
+    writer << snippets.lineNode << (0xf0001 + s) << "};";
+}
+
+/*
+    And finally what everyone else sees: a Converter, which hands everything
+    on to the Conversion it holds.
+*/
+
+Converter::Converter(const Options& options)
+    : conversion(new Conversion(options))
+{
+}
+
+Converter::~Converter()
+{
+}
+
+void Converter::begin(ostream* out)
+{
+    conversion->begin(out);
+}
+
+void Converter::feed(const uint8_t* bytes, size_t size)
+{
+    conversion->feed(bytes, size);
+}
+
+void Converter::finish()
+{
+    conversion->finish();
+}
+
+void Converter::onSign(SignHandler handler, void* context)
+{
+    conversion->onSign(handler, context);
+}
+
+int Converter::fswtotex(istream* fileIn, ostream* out)
+{
+    return conversion->fswtotex(fileIn, out);
+}
+
+int Converter::fswtotex(const uint8_t* bytes, size_t size, ostream* out)
+{
+    return conversion->fswtotex(bytes, size, out);
+}
+
+int Converter::fswtotex(const string& fileName, ostream* out)
+{
+    return conversion->fswtotex(fileName, out);
+}
+
+const Counts& Converter::counts() const
+{
+    return conversion->counts();
+}
+
+void Converter::loadCache()
+{
+    conversion->loadCache();
+}
+
+void Converter::saveCache()
+{
+    conversion->saveCache();
+}
+
+void Converter::loadIndex(const string& outName)
+{
+    conversion->loadIndex(outName);
+}
+
+void Converter::saveIndex(const string& outName)
+{
+    conversion->saveIndex(outName);
+}
+
+size_t Converter::benchDecode(const uint8_t* bytes, size_t size)
+{
+    return conversion->benchDecode(bytes, size);
+}
+
+void Converter::benchWrite(const Sign& sign)
+{
+    conversion->benchWrite(sign);
+}
+
+}
@@ -4,7 +4,10 @@
 #include <map>
 #include <string>
 
+#include "fswtotex.h"
+
 using namespace std;
+using namespace fswtotex;
 
 fstream fout;
 map <string, pair <string, string> > entries;
@@ -12,6 +15,7 @@ map <string, pair <string, string> > entries;
 void usage();
 string getline(fstream &fin);
 void sort(string filename);
+string horizontal(Converter &converter, string asl);
 
 int main(int argc, char**argv)
 {
@@ -88,15 +92,57 @@ void sort(string filename)
 {
     fstream fin;
     fin.open(filename, ios::in);
+    Converter converter((Options()));
     while(fin.peek()>-1)
     {
         string key,enu,asl;
         key = enu = getline(fin);
         asl = getline(fin);
         transform(key.begin(), key.end(), key.begin(), ::tolower);
-        asl = asl.substr(0,asl.find('M')) + "B" + asl.substr(asl.find('M')+1);
+        asl = horizontal(converter, asl);
         entries[key]=make_pair(enu,asl);
     }
     fin.close();
 }
 
+// The first sign in the middle lane, and where its lane is written.
+struct MiddleSign
+{
+    string text;
+    size_t lane;
+    char horizontal;
+};
+
+void findMiddle(const Sign &sign, const string &text, void *context)
+{
+    MiddleSign *found = static_cast<MiddleSign*>(context);
+    if(!found->text.empty() || sign.lane!='M')
+        return;
+    // Punctuation counts as the middle lane too, but has no lane written.
+    size_t lane = text.find('M');
+    char horizontal = 'B';
+    if(lane==string::npos)
+    {
+        lane = text.find("\xf0\x9d\xa0\x83");
+        if(lane==string::npos)
+            return;
+        lane += 3;
+        horizontal = '\x81';
+    }
+    found->text = text;
+    found->lane = lane;
+    found->horizontal = horizontal;
+}
+
+string horizontal(Converter &converter, string asl)
+{
+    MiddleSign found;
+    converter.onSign(findMiddle, &found);
+    converter.begin(0);
+    converter.feed(reinterpret_cast<const uint8_t*>(asl.data()), asl.size());
+    converter.finish();
+    if(found.text.empty())
+        return asl;
+    asl[asl.find(found.text)+found.lane] = found.horizontal;
+    return asl;
+}